@@ -0,0 +1,291 @@
+#include <stdbool.h>
+#include <string.h>
+#include "bitboard.h"
+#include "util.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_PEXT_DISPATCH 1
+#endif
+
+bitboard_t knight_attacks[64];
+bitboard_t king_attacks[64];
+bitboard_t pawn_attacks[2][64];
+bitboard_t between_bb[64][64];
+bitboard_t line_bb[64][64];
+uint64_t zobrist_pieces[2][6][64];
+uint64_t zobrist_side;
+uint64_t zobrist_ep[8];
+uint64_t zobrist_castle[16];
+
+// rays[dir][sq] holds every square from sq to the edge of the board in that direction
+// the first four directions increase the square index, the last four decrease it
+typedef enum {
+    DIR_N, DIR_E, DIR_NE, DIR_NW,
+    DIR_S, DIR_W, DIR_SW, DIR_SE,
+} RayDir;
+
+static const int ray_dx[8] = { 0, 1, 1, -1, 0, -1, -1, 1 };
+static const int ray_dy[8] = { 1, 0, 1, 1, -1, 0, -1, -1 };
+static bitboard_t rays[8][64];
+
+static bitboard_t offset_bb(int sq, int dx, int dy) {
+    const int x = (sq % 8) + dx;
+    const int y = (sq / 8) + dy;
+    if (x < 0 || x > 7 || y < 0 || y > 7) return 0;
+    return sq_bb((y * 8) + x);
+}
+
+// the squares along a ray up to and including the first occupied square
+static bitboard_t ray_attacks(int sq, bitboard_t occupied, RayDir dir) {
+    bitboard_t attacks = rays[dir][sq];
+    const bitboard_t blockers = attacks & occupied;
+    if (blockers) {
+        const int blocker_sq = (dir < DIR_S) ? bb_lsb(blockers) : bb_msb(blockers);
+        attacks ^= rays[dir][blocker_sq];
+    }
+    return attacks;
+}
+
+static bitboard_t slow_rook_attacks(int sq, bitboard_t occupied) {
+    return ray_attacks(sq, occupied, DIR_N) | ray_attacks(sq, occupied, DIR_E)
+        | ray_attacks(sq, occupied, DIR_S) | ray_attacks(sq, occupied, DIR_W);
+}
+
+static bitboard_t slow_bishop_attacks(int sq, bitboard_t occupied) {
+    return ray_attacks(sq, occupied, DIR_NE) | ray_attacks(sq, occupied, DIR_NW)
+        | ray_attacks(sq, occupied, DIR_SE) | ray_attacks(sq, occupied, DIR_SW);
+}
+
+// Slider attacks are looked up in precomputed tables indexed by the occupancy of the
+// squares that can block the slider (the edge squares never block, so they're masked off).
+// With BMI2 the index is pext(occupied, mask); otherwise it's the usual magic multiply.
+typedef struct {
+    bitboard_t mask;
+    bitboard_t magic;
+    bitboard_t *attacks;
+    int shift;
+} magic_t;
+
+static magic_t rook_magics[64];
+static magic_t bishop_magics[64];
+static bitboard_t rook_table[0x19000];
+static bitboard_t bishop_table[0x1480];
+static bool use_pext = false;
+
+#if defined(HAVE_PEXT_DISPATCH) && !defined(__BMI2__)
+__attribute__((target("bmi2")))
+static unsigned pext_index(bitboard_t occupied, bitboard_t mask) {
+    return (unsigned)_pext_u64(occupied, mask);
+}
+#endif
+
+static inline unsigned magic_index(const magic_t *m, bitboard_t occupied) {
+#if defined(__BMI2__)
+    return (unsigned)_pext_u64(occupied, m->mask);
+#else
+#ifdef HAVE_PEXT_DISPATCH
+    if (use_pext) return pext_index(occupied, m->mask);
+#endif
+    return (unsigned)(((occupied & m->mask) * m->magic) >> m->shift);
+#endif
+}
+
+static void init_magics(magic_t magics[64], bitboard_t *table, bitboard_t (*slow_attacks)(int, bitboard_t)) {
+    bitboard_t occupancy[4096];
+    bitboard_t reference[4096];
+    int epoch[4096] = { 0 };
+    int cur_epoch = 0;
+    uint64_t seed = 0x636F775F63686573ULL;
+    bitboard_t *attacks = table;
+    for (int sq=0; sq<64; sq++) {
+        magic_t *m = &magics[sq];
+        const bitboard_t edges = ((RANK_1_BB | RANK_8_BB) & ~(RANK_1_BB << (8 * (sq / 8))))
+            | ((FILE_A_BB | FILE_H_BB) & ~(FILE_A_BB << (sq % 8)));
+        m->mask = slow_attacks(sq, 0) & ~edges;
+        m->shift = 64 - bb_count(m->mask);
+        m->attacks = attacks;
+        // enumerate every subset of the mask (carry-rippler) along with its attack set
+        int size = 0;
+        bitboard_t b = 0;
+        do {
+            occupancy[size] = b;
+            reference[size] = slow_attacks(sq, b);
+            size++;
+            b = (b - m->mask) & m->mask;
+        } while (b);
+        attacks += size;
+        if (use_pext) {
+            for (int i=0; i<size; i++) {
+                m->attacks[magic_index(m, occupancy[i])] = reference[i];
+            }
+            continue;
+        }
+        // look for a multiplier that maps every subset to a slot without a destructive collision
+        for (int i=0; i<size; ) {
+            m->magic = 0;
+            while (bb_count((m->magic * m->mask) >> 56) < 6) {
+                m->magic = prng(&seed) & prng(&seed) & prng(&seed);
+            }
+            cur_epoch++;
+            for (i=0; i<size; i++) {
+                const unsigned idx = magic_index(m, occupancy[i]);
+                if (epoch[idx] < cur_epoch) {
+                    epoch[idx] = cur_epoch;
+                    m->attacks[idx] = reference[i];
+                } else if (m->attacks[idx] != reference[i]) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void init_bitboards(void) {
+    static bool initialized = false;
+    if (initialized) return;
+    const int knight_dx[8] = { -1, 1, -1, 1, 2, -2, 2, -2 };
+    const int knight_dy[8] = { 2, 2, -2, -2, 1, 1, -1, -1 };
+    const int king_dx[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+    const int king_dy[8] = { 1, 1, 1, 0, 0, -1, -1, -1 };
+    for (int sq=0; sq<64; sq++) {
+        knight_attacks[sq] = 0;
+        king_attacks[sq] = 0;
+        for (int i=0; i<8; i++) {
+            knight_attacks[sq] |= offset_bb(sq, knight_dx[i], knight_dy[i]);
+            king_attacks[sq] |= offset_bb(sq, king_dx[i], king_dy[i]);
+        }
+        pawn_attacks[0][sq] = offset_bb(sq, -1, 1) | offset_bb(sq, 1, 1);
+        pawn_attacks[1][sq] = offset_bb(sq, -1, -1) | offset_bb(sq, 1, -1);
+        for (int dir=0; dir<8; dir++) {
+            rays[dir][sq] = 0;
+            for (int n=1; n<8; n++) {
+                const bitboard_t b = offset_bb(sq, ray_dx[dir] * n, ray_dy[dir] * n);
+                if (!b) break;
+                rays[dir][sq] |= b;
+            }
+        }
+    }
+#if defined(__BMI2__)
+    use_pext = true;
+#elif defined(HAVE_PEXT_DISPATCH)
+    use_pext = __builtin_cpu_supports("bmi2");
+#endif
+    uint64_t seed = 0x7A6F627269737421ULL;
+    for (int c=0; c<2; c++) {
+        for (int t=0; t<6; t++) {
+            for (int sq=0; sq<64; sq++) zobrist_pieces[c][t][sq] = prng(&seed);
+        }
+    }
+    zobrist_side = prng(&seed);
+    for (int f=0; f<8; f++) zobrist_ep[f] = prng(&seed);
+    for (int i=0; i<16; i++) zobrist_castle[i] = prng(&seed);
+    init_magics(rook_magics, rook_table, slow_rook_attacks);
+    init_magics(bishop_magics, bishop_table, slow_bishop_attacks);
+    for (int a=0; a<64; a++) {
+        for (int b=0; b<64; b++) {
+            between_bb[a][b] = 0;
+            line_bb[a][b] = 0;
+            if (a == b) continue;
+            if (slow_rook_attacks(a, 0) & sq_bb(b)) {
+                between_bb[a][b] = slow_rook_attacks(a, sq_bb(b)) & slow_rook_attacks(b, sq_bb(a));
+                line_bb[a][b] = (slow_rook_attacks(a, 0) & slow_rook_attacks(b, 0)) | sq_bb(a) | sq_bb(b);
+            } else if (slow_bishop_attacks(a, 0) & sq_bb(b)) {
+                between_bb[a][b] = slow_bishop_attacks(a, sq_bb(b)) & slow_bishop_attacks(b, sq_bb(a));
+                line_bb[a][b] = (slow_bishop_attacks(a, 0) & slow_bishop_attacks(b, 0)) | sq_bb(a) | sq_bb(b);
+            }
+        }
+    }
+    initialized = true;
+}
+
+bitboard_t rook_attacks(int sq, bitboard_t occupied) {
+    const magic_t *m = &rook_magics[sq];
+    return m->attacks[magic_index(m, occupied)];
+}
+
+bitboard_t bishop_attacks(int sq, bitboard_t occupied) {
+    const magic_t *m = &bishop_magics[sq];
+    return m->attacks[magic_index(m, occupied)];
+}
+
+bitboard_t queen_attacks(int sq, bitboard_t occupied) {
+    return rook_attacks(sq, occupied) | bishop_attacks(sq, occupied);
+}
+
+// every square attacked by the piece on sq (not filtered by color)
+bitboard_t attacks_from(const position_t *pos, int sq) {
+    const int sprite = pos->mailbox[sq];
+    switch (sprite_type(sprite)) {
+        case KING: return king_attacks[sq];
+        case QUEEN: return queen_attacks(sq, pos->occupied);
+        case BISHOP: return bishop_attacks(sq, pos->occupied);
+        case KNIGHT: return knight_attacks[sq];
+        case ROOK: return rook_attacks(sq, pos->occupied);
+        case PAWN: return pawn_attacks[color_idx(sprite_color(sprite))][sq];
+        case NO_PIECE: return 0;
+    }
+    return 0;
+}
+
+// every piece of color 'by' that attacks sq, looking outward from sq with the given occupancy
+bitboard_t attackers_of(const position_t *pos, int sq, PieceColor by, bitboard_t occupied) {
+    const bitboard_t *p = pos->pieces[color_idx(by)];
+    return (pawn_attacks[color_idx(opposite_color(by))][sq] & p[PAWN])
+        | (knight_attacks[sq] & p[KNIGHT])
+        | (king_attacks[sq] & p[KING])
+        | (bishop_attacks(sq, occupied) & (p[BISHOP] | p[QUEEN]))
+        | (rook_attacks(sq, occupied) & (p[ROOK] | p[QUEEN]));
+}
+
+bool is_square_attacked(const position_t *pos, int sq, PieceColor by) {
+    const bitboard_t *p = pos->pieces[color_idx(by)];
+    if (pawn_attacks[color_idx(opposite_color(by))][sq] & p[PAWN]) return true;
+    if (knight_attacks[sq] & p[KNIGHT]) return true;
+    if (king_attacks[sq] & p[KING]) return true;
+    if ((p[BISHOP] | p[QUEEN]) && (bishop_attacks(sq, pos->occupied) & (p[BISHOP] | p[QUEEN]))) return true;
+    if ((p[ROOK] | p[QUEEN]) && (rook_attacks(sq, pos->occupied) & (p[ROOK] | p[QUEEN]))) return true;
+    return false;
+}
+
+void pos_clear(position_t *pos) {
+    memset(pos->pieces, 0, sizeof(pos->pieces));
+    memset(pos->colors, 0, sizeof(pos->colors));
+    pos->occupied = 0;
+    memset(pos->mailbox, -1, sizeof(pos->mailbox));
+    pos->king_sq[0] = pos->king_sq[1] = -1;
+    pos->key = 0;
+}
+
+void pos_put(position_t *pos, int sq, int sprite) {
+    pos_remove(pos, sq);
+    if (sprite < 0) return;
+    const int ci = color_idx(sprite_color(sprite));
+    const bitboard_t b = sq_bb(sq);
+    pos->pieces[ci][sprite_type(sprite)] |= b;
+    pos->colors[ci] |= b;
+    pos->occupied |= b;
+    pos->mailbox[sq] = (int8_t)sprite;
+    if (sprite_type(sprite) == KING) pos->king_sq[ci] = (int8_t)sq;
+    pos->key ^= zobrist_pieces[ci][sprite_type(sprite)][sq];
+}
+
+void pos_remove(position_t *pos, int sq) {
+    const int sprite = pos->mailbox[sq];
+    if (sprite < 0) return;
+    const int ci = color_idx(sprite_color(sprite));
+    const bitboard_t b = sq_bb(sq);
+    pos->pieces[ci][sprite_type(sprite)] &= ~b;
+    pos->colors[ci] &= ~b;
+    pos->occupied &= ~b;
+    pos->mailbox[sq] = -1;
+    if (sprite_type(sprite) == KING) pos->king_sq[ci] = -1;
+    pos->key ^= zobrist_pieces[ci][sprite_type(sprite)][sq];
+}
+
+void pos_from_board(position_t *pos, const int board[64]) {
+    pos_clear(pos);
+    for (int sq=0; sq<64; sq++) {
+        if (board[sq] >= 0) pos_put(pos, sq, board[sq]);
+    }
+}
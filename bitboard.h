@@ -0,0 +1,83 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include "chess_types.h"
+
+#define FILE_A_BB 0x0101010101010101ULL
+#define FILE_H_BB 0x8080808080808080ULL
+#define RANK_1_BB 0x00000000000000FFULL
+#define RANK_8_BB 0xFF00000000000000ULL
+
+extern bitboard_t knight_attacks[64];
+extern bitboard_t king_attacks[64];
+extern bitboard_t pawn_attacks[2][64];
+// squares strictly between two squares on a shared rank, file or diagonal (otherwise empty)
+extern bitboard_t between_bb[64][64];
+// the whole rank, file or diagonal through two aligned squares (otherwise empty)
+extern bitboard_t line_bb[64][64];
+
+// zobrist keys, seeded from prng() by init_bitboards
+extern uint64_t zobrist_pieces[2][6][64];
+extern uint64_t zobrist_side;
+extern uint64_t zobrist_ep[8];
+extern uint64_t zobrist_castle[16]; // indexed by the CASTLE_* bits
+
+static inline bitboard_t sq_bb(int sq) {
+    return 1ULL << sq;
+}
+
+static inline int bb_count(bitboard_t b) {
+    return __builtin_popcountll(b);
+}
+
+static inline int bb_lsb(bitboard_t b) {
+    return __builtin_ctzll(b);
+}
+
+static inline int bb_msb(bitboard_t b) {
+    return 63 - __builtin_clzll(b);
+}
+
+// returns the lowest set square and clears it from the bitboard
+static inline int bb_pop_lsb(bitboard_t *b) {
+    const int sq = __builtin_ctzll(*b);
+    *b &= *b - 1;
+    return sq;
+}
+
+// WHITE = 0 and BLACK = 8, so this maps them to 0 and 1
+static inline int color_idx(PieceColor color) {
+    return color >> 3;
+}
+
+static inline PieceColor opposite_color(PieceColor color) {
+    return (color == WHITE) ? BLACK : WHITE;
+}
+
+static inline int piece_sprite(PieceType type, PieceColor color) {
+    return (color == WHITE) ? type + KING_W : type + KING_B;
+}
+
+static inline PieceType sprite_type(int sprite) {
+    return (sprite < 0) ? NO_PIECE : (sprite > 23) ? sprite - KING_B : sprite - KING_W;
+}
+
+static inline PieceColor sprite_color(int sprite) {
+    return (sprite < 0) ? NO_COLOR : (sprite > 23) ? BLACK : WHITE;
+}
+
+void init_bitboards(void);
+
+bitboard_t rook_attacks(int sq, bitboard_t occupied);
+bitboard_t bishop_attacks(int sq, bitboard_t occupied);
+bitboard_t queen_attacks(int sq, bitboard_t occupied);
+bitboard_t attacks_from(const position_t *pos, int sq);
+bitboard_t attackers_of(const position_t *pos, int sq, PieceColor by, bitboard_t occupied);
+bool is_square_attacked(const position_t *pos, int sq, PieceColor by);
+
+void pos_clear(position_t *pos);
+void pos_put(position_t *pos, int sq, int sprite);
+void pos_remove(position_t *pos, int sq);
+void pos_from_board(position_t *pos, const int board[64]);
+
+#endif //BITBOARD_H
@@ -4,6 +4,7 @@
 #define CHESS_TYPES_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "utarray.h"
 
 typedef union  {
@@ -18,9 +19,22 @@ typedef union  {
 typedef struct {
     v2i from;
     v2i to;
-    int piece_id;
+    int piece_id; // the sprite that lands on 'to' (the promoted piece for a promotion)
 } move_t;
 
+// a move packed into 16 bits: bits 0-5 are the from square, 6-11 the to square, 12-15 the
+// MOVE_* flags; see pack_move and unpack_move in moves.c for converting to and from move_t
+typedef uint16_t packed_move_t;
+
+#define MOVE_NONE 0             // a1a1 is never a move, so zero works as "no move"
+#define MOVE_QUIET 0
+#define MOVE_DOUBLE_PUSH 1
+#define MOVE_CASTLE_SHORT 2
+#define MOVE_CASTLE_LONG 3
+#define MOVE_CAPTURE 4
+#define MOVE_EP_CAPTURE 5
+#define MOVE_PROMOTION 8        // the low two flag bits pick knight, bishop, rook or queen
+
 typedef enum {
     NO_PIECE = -1,
     KING = 0,
@@ -42,9 +56,52 @@ typedef struct {
     PieceColor color;
 } Piece;
 
+typedef uint64_t bitboard_t;
+
+// bitboard view of the board, kept in sync with game_t.board by set_board/unset_board
+typedef struct {
+    bitboard_t pieces[2][6]; // [color index][PieceType]
+    bitboard_t colors[2];    // [color index]
+    bitboard_t occupied;
+    int8_t mailbox[64];      // sprite id per square, -1 when empty
+    int8_t king_sq[2];       // [color index], -1 when that side has no king on the board
+    uint64_t key;            // zobrist key, see compute_key in moves.c
+} position_t;
+
+// castling rights, one bit each in game_t.castling
+#define CASTLE_WHITE_SHORT 1
+#define CASTLE_WHITE_LONG 2
+#define CASTLE_BLACK_SHORT 4
+#define CASTLE_BLACK_LONG 8
+#define CASTLE_ALL 15
+
+// how many position keys game_t remembers; a position can only repeat within the last 100
+// plies, because a capture or pawn move (which resets the fifty move count) can't be undone
+#define KEY_RING_SIZE 128
+
+// what make_move needs to remember so unmake_move can put the board back
+typedef struct {
+    move_t move;
+    int moved;        // sprite that left move.from
+    int captured;     // sprite that was captured, -1 for none
+    int captured_idx; // board index of the captured piece (not move.to for en passant)
+    int castling;     // castling rights before the move
+    int ep_square;    // en passant square before the move
+    int halfmove_clock; // fifty move count before the move
+    uint64_t key;     // zobrist key before the move
+} undo_t;
+
 typedef struct {
     int board[64];
+    position_t pos;
+    PieceColor to_move;
+    int castling;     // CASTLE_* bits for the castles still allowed
+    int ep_square;    // square a pawn can capture onto en passant this move, -1 when none
+    int halfmove_clock; // plies since the last capture or pawn move
+    int fullmove_number; // starts at 1 and goes up after each black move
+    uint64_t key_ring[KEY_RING_SIZE]; // position keys by ply (the undo stack length), modulo the size
     UT_array *moves;
+    UT_array *undo;
     v2i cur_sel;
     v2i *avail;
     int avail_len;
@@ -0,0 +1,202 @@
+#include "engine_channel.h"
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "util.h"
+
+// how long a quitting engine gets before it's killed
+#define QUIT_TIMEOUT_MS 1000
+
+static bool add_request(engine_channel *ch, uci_event_type reply, int timeout_ms, bool probe) {
+    // past this many the reply is just not waited for
+    if (ch->request_count == CHANNEL_MAX_REQUESTS) return false;
+    const int64_t now = system_msec();
+    ch->requests[ch->request_count++] = (channel_request){
+        .reply = reply,
+        .sent = now,
+        .deadline = (timeout_ms > 0) ? now + timeout_ms : 0,
+        .probe = probe,
+    };
+    return true;
+}
+
+static bool launch(engine_channel *ch) {
+    if (!spawn_uci_client(&ch->launch, &ch->cli)) return false;
+    if (!line_reader_init(&ch->lines, ch->cli.in_fd, UCI_READ_BUF_SIZE)) {
+        DIE("failed to allocate the uci line buffer\n");
+    }
+    ch->running = true;
+    ch->reaped = false;
+    ch->handshaken = false;
+    ch->request_count = 0;
+    ch->probing = false;
+    ch->latency_ms = -1;
+    engine_channel_request(ch, "uci\n", UCI_EVENT_UCIOK, CHANNEL_HANDSHAKE_TIMEOUT_MS);
+    return true;
+}
+
+static void close_process(engine_channel *ch, bool kill_it) {
+    if (kill_it && !ch->reaped) kill(ch->cli.pid, SIGKILL);
+    fclose(ch->cli.out);
+    close(ch->cli.in_fd);
+    if (!ch->reaped) waitpid(ch->cli.pid, NULL, 0);
+    line_reader_free(&ch->lines);
+}
+
+void engine_channel_start(engine_channel *ch, const engine_launch *launch_with) {
+    memset(ch, 0, sizeof(*ch));
+    ch->launch = *launch_with;
+    ch->start_failed = !launch(ch);
+}
+
+void engine_channel_send(engine_channel *ch, const char *cmd) {
+    if (ch->running) uci_send(&ch->cli, cmd);
+}
+
+void engine_channel_request(engine_channel *ch, const char *cmd, uci_event_type reply, int timeout_ms) {
+    if (!ch->running) return;
+    uci_send(&ch->cli, cmd);
+    add_request(ch, reply, timeout_ms, false);
+}
+
+void engine_channel_hurry(engine_channel *ch, uci_event_type reply, int timeout_ms) {
+    for (int i=0; i<ch->request_count; i++) {
+        channel_request *r = &ch->requests[i];
+        if (r->reply != reply || r->probe) continue;
+        r->deadline = system_msec() + timeout_ms;
+        return;
+    }
+}
+
+// waits up to timeout_ms for something to read and reads it; returns how much was read, 0 when
+// nothing came or the engine closed its end (which sets eof)
+static ssize_t wait_and_fill(engine_channel *ch, int timeout_ms) {
+    struct pollfd pfd = { .fd = ch->cli.in_fd, .events = POLLIN };
+    if (poll(&pfd, 1, timeout_ms) <= 0) return 0;
+    return line_reader_fill(&ch->lines);
+}
+
+void engine_channel_stop(engine_channel *ch) {
+    if (!ch->running) return;
+    uci_send(&ch->cli, "quit\n");
+    const int64_t deadline = system_msec() + QUIT_TIMEOUT_MS;
+    int64_t left;
+    line_view line;
+    while ((left = deadline - system_msec()) > 0) {
+        // the buffer has to have room, or the engine blocks writing to us and never gets to quit
+        while (line_reader_pop(&ch->lines, &line)) {}
+        if (!ch->reaped && waitpid(ch->cli.pid, NULL, WNOHANG) == ch->cli.pid) ch->reaped = true;
+        if (ch->reaped) break;
+        // closing its output isn't the same as exiting, so keep checking on it either way
+        if (ch->lines.eof) {
+            system_sleep(1);
+        } else {
+            wait_and_fill(ch, (int)min(left, (int64_t)10));
+        }
+    }
+    // whatever hasn't exited by the deadline is killed, so the waitpid can't hang
+    close_process(ch, true);
+    ch->running = false;
+}
+
+// matches a reply to the oldest request waiting for it; false for the answer to a probe, which
+// the caller never asked for
+static bool take_reply(engine_channel *ch, const uci_event *ev) {
+    const int64_t now = system_msec();
+    if (ev->type == UCI_EVENT_UCIOK && !ch->handshaken) {
+        ch->handshaken = true;
+        ch->next_probe = now + CHANNEL_PROBE_INTERVAL_MS;
+    }
+    // a search finished, so whatever made the engine fall over before is behind us
+    if (ev->type == UCI_EVENT_BESTMOVE) ch->restarts = 0;
+    for (int i=0; i<ch->request_count; i++) {
+        const channel_request r = ch->requests[i];
+        if (r.reply != ev->type) continue;
+        memmove(&ch->requests[i], &ch->requests[i + 1], (ch->request_count - i - 1) * sizeof(channel_request));
+        ch->request_count--;
+        if (!r.probe) return true;
+        ch->latency_ms = (int)(now - r.sent);
+        ch->probing = false;
+        ch->next_probe = now + CHANNEL_PROBE_INTERVAL_MS;
+        return false;
+    }
+    return true;
+}
+
+// reports the engine as lost and starts another one in its place, if it hasn't failed too often
+static bool fail(engine_channel *ch, uci_event *ev, const char *why) {
+    ev->type = UCI_EVENT_EOF;
+    ev->bestmove[0] = '\0';
+    ev->ponder[0] = '\0';
+    snprintf(ev->line, sizeof(ev->line), "%s", why);
+    close_process(ch, true);
+    ch->running = false;
+    // an engine that can't even be started again is gone for good
+    if (ch->restarts < CHANNEL_MAX_RESTARTS) {
+        ch->restarts++;
+        launch(ch);
+    }
+    return true;
+}
+
+// the earliest time something has to be checked, 0 for none
+static int64_t next_wakeup(const engine_channel *ch) {
+    int64_t wake = 0;
+    for (int i=0; i<ch->request_count; i++) {
+        const int64_t d = ch->requests[i].deadline;
+        if (d > 0 && (wake == 0 || d < wake)) wake = d;
+    }
+    if (ch->handshaken && !ch->probing && (wake == 0 || ch->next_probe < wake)) wake = ch->next_probe;
+    return wake;
+}
+
+bool engine_channel_next(engine_channel *ch, uci_event *ev, int timeout_ms) {
+    if (ch->start_failed) {
+        ch->start_failed = false;
+        ev->type = UCI_EVENT_EOF;
+        ev->bestmove[0] = '\0';
+        ev->ponder[0] = '\0';
+        snprintf(ev->line, sizeof(ev->line), "failed to start the engine");
+        return true;
+    }
+    const int64_t until = (timeout_ms >= 0) ? system_msec() + timeout_ms : 0;
+    while (ch->running) {
+        line_view line;
+        while (line_reader_pop(&ch->lines, &line)) {
+            const size_t len = min(line.len, sizeof(ev->line) - 1);
+            memcpy(ev->line, line.ptr, len);
+            ev->line[len] = '\0';
+            parse_uci_event(ev);
+            if (take_reply(ch, ev)) return true;
+        }
+        if (ch->lines.eof) return fail(ch, ev, "engine exited");
+        if (!ch->reaped && waitpid(ch->cli.pid, NULL, WNOHANG) == ch->cli.pid) ch->reaped = true;
+        // whatever it wrote before going is still worth reading, but something else may be holding
+        // the pipe open, so don't wait for the end of it
+        if (ch->reaped) {
+            if (wait_and_fill(ch, 0) > 0) continue;
+            return fail(ch, ev, "engine exited");
+        }
+        const int64_t now = system_msec();
+        for (int i=0; i<ch->request_count; i++) {
+            const int64_t d = ch->requests[i].deadline;
+            if (d > 0 && now >= d) return fail(ch, ev, "engine stopped answering");
+        }
+        if (ch->handshaken && !ch->probing && now >= ch->next_probe) {
+            if (add_request(ch, UCI_EVENT_READYOK, CHANNEL_PROBE_TIMEOUT_MS, true)) {
+                uci_send(&ch->cli, "isready\n");
+                ch->probing = true;
+            } else {
+                ch->next_probe = now + CHANNEL_PROBE_INTERVAL_MS;
+            }
+        }
+        int64_t wake = next_wakeup(ch);
+        if (until > 0 && (wake == 0 || until < wake)) wake = until;
+        const int wait = (wake == 0) ? -1 : (int)max(wake - now, (int64_t)0);
+        if (wait_and_fill(ch, wait) == 0 && until > 0 && system_msec() >= until) return false;
+    }
+    return false;
+}
@@ -0,0 +1,64 @@
+#ifndef ENGINE_CHANNEL_H
+#define ENGINE_CHANNEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "line_reader.h"
+#include "uci.h"
+
+// One engine process, read with poll() on the caller's thread, with a deadline on each reply the
+// caller is waiting for. Once the handshake is done the engine also gets an isready every so
+// often. It has to answer that even in the middle of a search, so a wedged engine is noticed
+// without knowing how long its search ought to take. An engine that exits or misses a deadline is
+// killed, reaped and started again. The caller sees a UCI_EVENT_EOF and then the new engine's
+// uciok, and replays whatever it had asked the old one for.
+
+#define CHANNEL_MAX_REQUESTS 8
+#define CHANNEL_HANDSHAKE_TIMEOUT_MS 10000
+#define CHANNEL_PROBE_INTERVAL_MS 2000
+#define CHANNEL_PROBE_TIMEOUT_MS 10000
+// restarts in a row without a search finishing before the channel gives up on the engine
+#define CHANNEL_MAX_RESTARTS 3
+
+typedef struct {
+    uci_event_type reply;
+    int64_t sent;           // system_msec times
+    int64_t deadline;       // 0 for none
+    bool probe;             // the channel's own isready, so the reply isn't passed on
+} channel_request;
+
+typedef struct {
+    engine_launch launch;   // kept for restarts
+    uci_client cli;
+    line_reader lines;
+    bool running;           // false once the channel has given up on the engine
+    bool start_failed;      // the engine couldn't be started at all; reported by engine_channel_next
+    bool reaped;
+    bool handshaken;        // uciok has come back, so probes can go out
+    channel_request requests[CHANNEL_MAX_REQUESTS];    // oldest first
+    int request_count;
+    bool probing;
+    int64_t next_probe;
+    int latency_ms;         // round trip of the last probe, -1 until one has come back
+    int restarts;
+} engine_channel;
+
+// starts the engine and sends "uci"; the uciok comes back through engine_channel_next, or if the
+// engine can't be started, a UCI_EVENT_EOF with ch->running false
+void engine_channel_start(engine_channel *ch, const engine_launch *launch);
+// sends "quit", gives the engine a moment to go and kills it if it doesn't
+void engine_channel_stop(engine_channel *ch);
+// sends a command that doesn't get an answer
+void engine_channel_send(engine_channel *ch, const char *cmd);
+// sends a command whose answer is the next event of type 'reply', which has to come within
+// timeout_ms (0 for no limit but the probes)
+void engine_channel_request(engine_channel *ch, const char *cmd, uci_event_type reply, int timeout_ms);
+// the oldest outstanding request for 'reply' now has timeout_ms from now; for "stop" and
+// "ponderhit", which hurry along a search that's already running
+void engine_channel_hurry(engine_channel *ch, uci_event_type reply, int timeout_ms);
+// waits up to timeout_ms (0 to not wait at all, -1 for as long as it takes) for the next event
+// and returns false if none came. Losing the engine comes back as UCI_EVENT_EOF, with the reason
+// in ev->line; by then a new one is starting, unless ch->running says the channel gave up.
+bool engine_channel_next(engine_channel *ch, uci_event *ev, int timeout_ms);
+
+#endif //ENGINE_CHANNEL_H
@@ -0,0 +1,336 @@
+#include "engine_pool.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include "threadpool.h"
+#include "util.h"
+
+// how long the engines get to quit before they're killed
+#define QUIT_TIMEOUT_MS 1000
+
+static const UT_icd queued_job_icd = { sizeof(queued_job), NULL, NULL, NULL };
+
+static void report(engine_pool *pool, const analysis_result *result) {
+    if (pool->on_done != NULL) pool->on_done(result, pool->ctx);
+}
+
+static void fail_job(engine_pool *pool, const analysis_job *job) {
+    analysis_result result = { .id = job->id, .engine = -1, .ok = false };
+    report(pool, &result);
+}
+
+static bool pop_job(engine_pool *pool, queued_job *job) {
+    if (pool->queue_head >= utarray_len(pool->queue)) return false;
+    *job = *(queued_job *)utarray_eltptr(pool->queue, pool->queue_head);
+    if (++pool->queue_head == utarray_len(pool->queue)) {
+        utarray_clear(pool->queue);
+        pool->queue_head = 0;
+    }
+    return true;
+}
+
+// hands queued jobs to every idle engine
+static void dispatch(engine_pool *pool) {
+    for (int i=0; i<pool->count; i++) {
+        pool_engine *e = &pool->engines[i];
+        if (e->state != ENGINE_IDLE) continue;
+        while (pop_job(pool, &e->task)) {
+            if (!load_fen(&e->game, e->task.job.fen)) {
+                fail_job(pool, &e->task.job);
+                continue;
+            }
+            e->task.attempts++;
+            const int movetime = e->task.job.limits.movetime;
+            e->deadline = system_msec() + ((movetime > 0) ? movetime + POOL_MOVETIME_MARGIN_MS : POOL_SEARCH_TIMEOUT_MS);
+            char cmd[MAX_FEN_LEN + 32];
+            sprintf(cmd, "position fen %s\n", e->task.job.fen);
+            uci_send(&e->cli, cmd);
+            char go[UCI_GO_MAX];
+            uci_go_command(&e->task.job.limits, go);
+            uci_send(&e->cli, go);
+            memset(&e->info, 0, sizeof(e->info));
+            e->state = ENGINE_BUSY;
+            pool->running++;
+            break;
+        }
+    }
+}
+
+// kills the engine and hands its job on
+static void bury_engine(engine_pool *pool, int idx, const char *why) {
+    pool_engine *e = &pool->engines[idx];
+    fprintf(stderr, "-=-= engine %d %s\n", idx, why);
+    if (e->state == ENGINE_BUSY) {
+        pool->running--;
+        // somebody else can have its job, unless it looks like the job is what's killing them
+        if (e->task.attempts < POOL_MAX_ATTEMPTS) {
+            utarray_push_back(pool->queue, &e->task);
+        } else {
+            fprintf(stderr, "-=-= giving up on %s\n", e->task.job.fen);
+            fail_job(pool, &e->task.job);
+        }
+    }
+    e->state = ENGINE_DEAD;
+    e->deadline = 0;
+#ifdef __linux__
+    epoll_ctl(pool->epoll_fd, EPOLL_CTL_DEL, e->cli.in_fd, NULL);
+#endif
+    // it may have only closed its output, or be stuck, so make sure the waitpid doesn't hang
+    kill(e->cli.pid, SIGKILL);
+    fclose(e->cli.out);
+    close(e->cli.in_fd);
+    waitpid(e->cli.pid, NULL, 0);
+    line_reader_free(&e->lines);
+}
+
+// starts the engine in slot idx and its handshake; false, leaving it dead, if it can't be started
+static bool launch_engine(engine_pool *pool, int idx) {
+    pool_engine *e = &pool->engines[idx];
+    if (!spawn_uci_client(&pool->profile->launch, &e->cli)) {
+        e->state = ENGINE_DEAD;
+        return false;
+    }
+    // the event loop only reads once it knows there's something there, but never block on it
+    fcntl(e->cli.in_fd, F_SETFL, fcntl(e->cli.in_fd, F_GETFL) | O_NONBLOCK);
+    if (!line_reader_init(&e->lines, e->cli.in_fd, UCI_READ_BUF_SIZE)) {
+        DIE("failed to allocate the uci line buffer\n");
+    }
+    e->state = ENGINE_STARTING;
+    e->deadline = system_msec() + POOL_HANDSHAKE_TIMEOUT_MS;
+#ifdef __linux__
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = idx };
+    epoll_ctl(pool->epoll_fd, EPOLL_CTL_ADD, e->cli.in_fd, &ev);
+#endif
+    uci_send(&e->cli, "uci\n");
+    return true;
+}
+
+// returns true when the line finished a job
+static bool handle_line(engine_pool *pool, int idx, line_view line) {
+    pool_engine *e = &pool->engines[idx];
+    uci_event ev;
+    const size_t len = min(line.len, sizeof(ev.line) - 1);
+    memcpy(ev.line, line.ptr, len);
+    ev.line[len] = '\0';
+    parse_uci_event(&ev);
+    switch (ev.type) {
+        case UCI_EVENT_UCIOK: {
+            for (int i=0; i<pool->profile->option_count; i++) {
+                char cmd[UCI_LINE_MAX];
+                uci_option_command(pool->profile->options[i], cmd);
+                uci_send(&e->cli, cmd);
+            }
+            uci_send(&e->cli, "ucinewgame\n");
+            uci_send(&e->cli, "isready\n");
+            break;
+        }
+        case UCI_EVENT_READYOK: {
+            if (e->state == ENGINE_STARTING) {
+                e->state = ENGINE_IDLE;
+                e->deadline = 0;
+            }
+            break;
+        }
+        case UCI_EVENT_INFO: {
+            uci_info info;
+            if (e->state != ENGINE_BUSY || !parse_uci_info(&e->game, ev.line, &info)) break;
+            // the best line of a multipv search is the one that's kept
+            if ((info.fields & INFO_MULTIPV) && info.multipv > 1) info.fields &= ~INFO_LINE_FIELDS;
+            merge_uci_info(&e->info, &info);
+            break;
+        }
+        case UCI_EVENT_BESTMOVE: {
+            if (e->state != ENGINE_BUSY) break;
+            analysis_result result = { .id = e->task.job.id, .engine = idx, .ok = true, .info = e->info };
+            strcpy(result.bestmove, ev.bestmove);
+            strcpy(result.ponder, ev.ponder);
+            e->state = ENGINE_IDLE;
+            e->deadline = 0;
+            pool->running--;
+            report(pool, &result);
+            return true;
+        }
+        default: {
+            break;
+        }
+    }
+    return false;
+}
+
+// reads what's waiting on one engine's pipe and handles every whole line of it
+static int service_engine(engine_pool *pool, int idx) {
+    pool_engine *e = &pool->engines[idx];
+    int finished = 0;
+    line_reader_fill(&e->lines);
+    line_view line;
+    while (line_reader_pop(&e->lines, &line)) {
+        if (handle_line(pool, idx, line)) finished++;
+    }
+    if (e->lines.eof) bury_engine(pool, idx, "exited");
+    return finished;
+}
+
+// an engine that's stuck starting is given up on, and one that's stuck searching is replaced
+static void check_deadlines(engine_pool *pool) {
+    const int64_t now = system_msec();
+    for (int i=0; i<pool->count; i++) {
+        pool_engine *e = &pool->engines[i];
+        if (e->state == ENGINE_DEAD || e->deadline == 0 || now < e->deadline) continue;
+        const bool searching = (e->state == ENGINE_BUSY);
+        bury_engine(pool, i, "stopped answering");
+        if (searching) launch_engine(pool, i);
+    }
+}
+
+// timeout_ms, cut short so the loop wakes up in time for the first deadline
+static int wait_time(const engine_pool *pool, int timeout_ms) {
+    int64_t wake = 0;
+    for (int i=0; i<pool->count; i++) {
+        const pool_engine *e = &pool->engines[i];
+        if (e->state != ENGINE_DEAD && e->deadline > 0 && (wake == 0 || e->deadline < wake)) wake = e->deadline;
+    }
+    if (wake == 0) return timeout_ms;
+    const int left = (int)max(wake - system_msec(), (int64_t)0);
+    return (timeout_ms < 0 || left < timeout_ms) ? left : timeout_ms;
+}
+
+// once every engine is gone nothing queued is ever going to run
+static bool fail_if_no_engines(engine_pool *pool) {
+    for (int i=0; i<pool->count; i++) {
+        if (pool->engines[i].state != ENGINE_DEAD) return false;
+    }
+    queued_job job;
+    while (pop_job(pool, &job)) fail_job(pool, &job.job);
+    return true;
+}
+
+// how many search threads each copy of the engine runs, going by the profile's Threads option
+static int engine_threads(const engine_profile *profile) {
+    for (int i=0; i<profile->option_count; i++) {
+        const char *option = profile->options[i];
+        // option names aren't case sensitive
+        if (strncasecmp(option, "Threads=", 8) == 0) return max(atoi(option + 8), 1);
+    }
+    return 1;
+}
+
+bool engine_pool_start(engine_pool *pool, const engine_profile *profile, int count, analysis_done_fn on_done,
+                       void *ctx) {
+    // enough copies to keep every cpu busy, and no more
+    if (count <= 0) count = max(system_cpu_count() / engine_threads(profile), 1);
+    memset(pool, 0, sizeof(*pool));
+    pool->count = count;
+    pool->profile = profile;
+    pool->on_done = on_done;
+    pool->ctx = ctx;
+    pool->engines = calloc(count, sizeof(pool_engine));
+    pool->pfds = calloc(count, sizeof(struct pollfd));
+    utarray_new(pool->queue, &queued_job_icd);
+    pool->epoll_fd = -1;
+#ifdef __linux__
+    pool->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (pool->epoll_fd < 0) {
+        perror("epoll_create1");
+        return false;
+    }
+#endif
+    for (int i=0; i<count; i++) {
+        init_game(&pool->engines[i].game);
+        launch_engine(pool, i);
+    }
+    return true;
+}
+
+void engine_pool_stop(engine_pool *pool) {
+    bool *reaped = calloc(pool->count, sizeof(bool));
+    for (int i=0; i<pool->count; i++) {
+        if (pool->engines[i].state != ENGINE_DEAD) uci_send(&pool->engines[i].cli, "quit\n");
+    }
+    const int64_t deadline = system_msec() + QUIT_TIMEOUT_MS;
+    bool waiting = true;
+    while (waiting && system_msec() < deadline) {
+        waiting = false;
+        for (int i=0; i<pool->count; i++) {
+            pool_engine *e = &pool->engines[i];
+            if (e->state == ENGINE_DEAD || reaped[i]) continue;
+            // the pipe has to have room, or the engine blocks writing to us and never gets to quit
+            line_view line;
+            while (line_reader_pop(&e->lines, &line)) {}
+            line_reader_fill(&e->lines);
+            reaped[i] = (waitpid(e->cli.pid, NULL, WNOHANG) == e->cli.pid);
+            if (!reaped[i]) waiting = true;
+        }
+        if (waiting) system_sleep(1);
+    }
+    for (int i=0; i<pool->count; i++) {
+        pool_engine *e = &pool->engines[i];
+        if (e->state != ENGINE_DEAD) {
+            // whatever hasn't exited by the deadline is killed, so the waitpid can't hang
+            if (!reaped[i]) kill(e->cli.pid, SIGKILL);
+            fclose(e->cli.out);
+            close(e->cli.in_fd);
+            if (!reaped[i]) waitpid(e->cli.pid, NULL, 0);
+        }
+        line_reader_free(&e->lines);
+        free_game(&e->game);
+    }
+#ifdef __linux__
+    close(pool->epoll_fd);
+#endif
+    free(reaped);
+    utarray_free(pool->queue);
+    free(pool->pfds);
+    free(pool->engines);
+    memset(pool, 0, sizeof(*pool));
+}
+
+void engine_pool_submit(engine_pool *pool, const analysis_job *job) {
+    const queued_job queued = { .job = *job };
+    utarray_push_back(pool->queue, &queued);
+}
+
+int engine_pool_run(engine_pool *pool, int timeout_ms) {
+    int finished = 0;
+    if (fail_if_no_engines(pool)) return 0;
+    dispatch(pool);
+#ifdef __linux__
+    struct epoll_event events[16];
+    const int n = epoll_wait(pool->epoll_fd, events, 16, wait_time(pool, timeout_ms));
+    for (int i=0; i<n; i++) {
+        finished += service_engine(pool, events[i].data.u32);
+    }
+#else
+    int nfds = 0;
+    for (int i=0; i<pool->count; i++) {
+        if (pool->engines[i].state == ENGINE_DEAD) continue;
+        pool->pfds[nfds++] = (struct pollfd){ .fd = pool->engines[i].cli.in_fd, .events = POLLIN };
+    }
+    if (poll(pool->pfds, nfds, wait_time(pool, timeout_ms)) > 0) {
+        for (int i=0, k=0; i<pool->count; i++) {
+            if (pool->engines[i].state == ENGINE_DEAD) continue;
+            if (pool->pfds[k++].revents != 0) finished += service_engine(pool, i);
+        }
+    }
+#endif
+    check_deadlines(pool);
+    if (!fail_if_no_engines(pool)) dispatch(pool);
+    return finished;
+}
+
+bool engine_pool_busy(const engine_pool *pool) {
+    return pool->running > 0 || pool->queue_head < utarray_len(pool->queue);
+}
+
+void engine_pool_wait(engine_pool *pool) {
+    while (engine_pool_busy(pool)) {
+        engine_pool_run(pool, -1);
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef ENGINE_POOL_H
+#define ENGINE_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <poll.h>
+#include "chess_types.h"
+#include "engine_profile.h"
+#include "line_reader.h"
+#include "moves.h"
+#include "uci.h"
+#include "uci_info.h"
+
+// A set of copies of one engine, each its own process, that analyse queued positions side by
+// side. All of their pipes are watched by one event loop (epoll on linux, poll elsewhere) that
+// runs on the caller's thread whenever it calls engine_pool_run, so there are no extra threads.
+
+// engines a job can take down with it before it's failed instead of handed to another one
+#define POOL_MAX_ATTEMPTS 2
+// past these an engine is taken to be stuck: one that hasn't finished its handshake is given up
+// on, and one that's searching is killed and started again
+#define POOL_HANDSHAKE_TIMEOUT_MS 10000
+#define POOL_MOVETIME_MARGIN_MS 5000    // on top of the job's movetime
+#define POOL_SEARCH_TIMEOUT_MS 60000    // for a job without a movetime
+
+typedef struct {
+    int id;             // the caller's own, handed back with the result
+    char fen[MAX_FEN_LEN];
+    search_limits limits;
+} analysis_job;
+
+// a job as the pool keeps it
+typedef struct {
+    analysis_job job;
+    int attempts;       // engines it has been handed to
+} queued_job;
+
+typedef struct {
+    int id;
+    int engine;         // index of the engine that ran the job
+    bool ok;            // false when the fen was bad, the job took down POOL_MAX_ATTEMPTS engines or
+                        // every engine has died
+    char bestmove[6];   // empty when the side to move has no move
+    char ponder[6];
+    uci_info info;      // everything the engine reported during the search, merged
+} analysis_result;
+
+typedef void (*analysis_done_fn)(const analysis_result *result, void *ctx);
+
+typedef enum {
+    ENGINE_STARTING,    // waiting for the uci handshake to finish
+    ENGINE_IDLE,
+    ENGINE_BUSY,
+    ENGINE_DEAD,
+} engine_state;
+
+typedef struct {
+    uci_client cli;
+    line_reader lines;
+    engine_state state;
+    int64_t deadline;   // system_msec time it has to be done starting or searching by, 0 for none
+    queued_job task;    // the job it's running while busy
+    game_t game;        // the job's position, for checking the pv moves
+    uci_info info;
+} pool_engine;
+
+typedef struct {
+    pool_engine *engines;
+    int count;
+    int epoll_fd;       // -1 where the pool falls back to poll
+    struct pollfd *pfds;
+    UT_array *queue;    // queued_job, waiting for an idle engine
+    unsigned queue_head;
+    int running;        // jobs handed to an engine and not finished yet
+    const engine_profile *profile;
+    analysis_done_fn on_done;
+    void *ctx;
+} engine_pool;
+
+// starts 'count' copies of the profile's engine (when count <= 0, as many as fit on the cpus with
+// the profile's Threads each) and the handshake with each of them, which sets the profile's
+// options. The profile has to outlive the pool, and the jobs bring their own limits. on_done is called from engine_pool_run as each job finishes.
+bool engine_pool_start(engine_pool *pool, const engine_profile *profile, int count, analysis_done_fn on_done,
+    void *ctx);
+// tells every engine to quit, gives them a moment to exit, kills the ones that don't and frees
+// everything
+void engine_pool_stop(engine_pool *pool);
+void engine_pool_submit(engine_pool *pool, const analysis_job *job);
+// handles everything the engines have said, waiting up to timeout_ms for something to arrive (0
+// to not wait at all, -1 to wait as long as it takes), and hands queued jobs to idle engines. An
+// engine that misses its deadline is killed, and started again if it was searching. Returns how
+// many searches finished.
+int engine_pool_run(engine_pool *pool, int timeout_ms);
+// true while jobs are queued or running
+bool engine_pool_busy(const engine_pool *pool);
+// runs the event loop until every job submitted so far has finished
+void engine_pool_wait(engine_pool *pool);
+
+#endif //ENGINE_POOL_H
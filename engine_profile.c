@@ -0,0 +1,159 @@
+#include "engine_profile.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the value after 'key' if the setting is for it
+static const char *setting_value(const char *setting, const char *key) {
+    const size_t len = strlen(key);
+    return (strncmp(setting, key, len) == 0) ? setting + len : NULL;
+}
+
+static bool set_limit(search_limits *limits, const char *setting) {
+    const char *v;
+    if ((v = setting_value(setting, "depth=")) != NULL) {
+        limits->depth = atoi(v);
+    } else if ((v = setting_value(setting, "nodes=")) != NULL) {
+        limits->nodes = strtoull(v, NULL, 10);
+    } else if ((v = setting_value(setting, "movetime=")) != NULL) {
+        limits->movetime = atoi(v);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool set_engine_profile(engine_profile *profile, const char *setting) {
+    engine_launch *l = &profile->launch;
+    const char *v;
+    if ((v = setting_value(setting, "cmd=")) != NULL) {
+        l->exe = v;
+    } else if ((v = setting_value(setting, "arg=")) != NULL) {
+        if (l->arg_count == UCI_MAX_ARGS) return false;
+        l->args[l->arg_count++] = v;
+    } else if ((v = setting_value(setting, "env.")) != NULL && strchr(v, '=') != NULL) {
+        if (l->env_count == UCI_MAX_ENV) return false;
+        l->env[l->env_count++] = v;
+    } else if ((v = setting_value(setting, "dir=")) != NULL) {
+        l->cwd = v;
+    } else if ((v = setting_value(setting, "stderr=")) != NULL) {
+        l->stderr_path = v;
+    } else if ((v = setting_value(setting, "name=")) != NULL) {
+        profile->name = v;
+    } else if ((v = setting_value(setting, "option.")) != NULL && strchr(v, '=') != NULL) {
+        if (profile->option_count == MAX_ENGINE_OPTIONS) return false;
+        profile->options[profile->option_count++] = v;
+    } else if ((v = setting_value(setting, "warmup.")) != NULL) {
+        return set_limit(&profile->warmup, v);
+    } else {
+        return set_limit(&profile->limits, setting);
+    }
+    return true;
+}
+
+bool has_search_limits(const search_limits *limits) {
+    return limits->depth > 0 || limits->nodes > 0 || limits->movetime > 0;
+}
+
+void uci_option_command(const char *option, char cmd[UCI_LINE_MAX]) {
+    const char *eq = strchr(option, '=');
+    snprintf(cmd, UCI_LINE_MAX, "setoption name %.*s value %s\n", (int)(eq - option), option, eq + 1);
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return s;
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return NULL;
+    size_t len = 0, cap = 4096;
+    char *text = malloc(cap);
+    size_t got;
+    while ((got = fread(text + len, 1, cap - len - 1, f)) > 0) {
+        len += got;
+        if (cap - len == 1) text = realloc(text, cap *= 2);
+    }
+    fclose(f);
+    text[len] = '\0';
+    return text;
+}
+
+static bool parse_error(engine_profiles *set, const char *path, int line_no, const char *why) {
+    fprintf(stderr, "%s:%d: %s\n", path, line_no, why);
+    free_engine_profiles(set);
+    return false;
+}
+
+bool load_engine_profiles(engine_profiles *set, const char *path) {
+    memset(set, 0, sizeof(*set));
+    set->text = read_file(path);
+    if (set->text == NULL) {
+        perror(path);
+        return false;
+    }
+    int cap = 0;
+    int line_no = 0;
+    char *next;
+    for (char *line = set->text; line != NULL; line = next) {
+        next = strchr(line, '\n');
+        if (next != NULL) *next++ = '\0';
+        line_no++;
+        char *s = trim(line);
+        if (*s == '\0' || *s == '#') continue;
+        if (*s == '[') {
+            char *end = strchr(s, ']');
+            if (end == NULL) return parse_error(set, path, line_no, "profile name without a closing ]");
+            *end = '\0';
+            if (set->count == cap) {
+                cap = (cap > 0) ? cap * 2 : 8;
+                set->profiles = realloc(set->profiles, cap * sizeof(engine_profile));
+            }
+            set->profiles[set->count++] = (engine_profile){ .name = trim(s + 1) };
+            continue;
+        }
+        if (set->count == 0) return parse_error(set, path, line_no, "setting before the first [profile]");
+        // squeeze "key = value" into the "key=value" the settings are
+        char *eq = strchr(s, '=');
+        if (eq == NULL) return parse_error(set, path, line_no, "expected key = value");
+        char *key_end = eq;
+        while (key_end > s && isspace((unsigned char)key_end[-1])) key_end--;
+        char *value = eq + 1;
+        while (isspace((unsigned char)*value)) value++;
+        memmove(key_end + 1, value, strlen(value) + 1);
+        *key_end = '=';
+        // the [name] line names the profile, and -engine and profile= look it up by that
+        if (strncmp(s, "name=", 5) == 0) {
+            return parse_error(set, path, line_no, "name can't be set here, the [section] is the profile's name");
+        }
+        if (!set_engine_profile(&set->profiles[set->count - 1], s)) {
+            return parse_error(set, path, line_no, "unknown setting, or too many of it");
+        }
+    }
+    for (int i=0; i<set->count; i++) {
+        if (set->profiles[i].launch.exe == NULL) {
+            fprintf(stderr, "%s: profile %s has no cmd\n", path, set->profiles[i].name);
+            free_engine_profiles(set);
+            return false;
+        }
+    }
+    return true;
+}
+
+void free_engine_profiles(engine_profiles *set) {
+    free(set->profiles);
+    free(set->text);
+    memset(set, 0, sizeof(*set));
+}
+
+const engine_profile *find_engine_profile(const engine_profiles *set, const char *name) {
+    for (int i=0; i<set->count; i++) {
+        if (name == NULL || strcmp(set->profiles[i].name, name) == 0) return &set->profiles[i];
+    }
+    return NULL;
+}
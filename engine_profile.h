@@ -0,0 +1,57 @@
+#ifndef ENGINE_PROFILE_H
+#define ENGINE_PROFILE_H
+
+#include <stdbool.h>
+#include "uci.h"
+
+// How to run and set up one engine: the command that starts it, the UCI options it's given after
+// the handshake, the limits on its searches and an optional warm-up search, which runs once at
+// startup so the engine has loaded its network and touched its hash before the first real move.
+//
+// Profiles are read from a config file. Each starts with its name in brackets, followed by one
+// "key = value" setting per line; blank lines and lines starting with '#' are skipped.
+//
+//   [lc0-cuda]
+//   cmd = lc0
+//   arg = --backend=cuda
+//   option.Threads = 2
+//   depth = 3
+//   warmup.nodes = 800
+//
+// The keys are the ones cow_match takes on its command line: cmd, arg (once per argument),
+// env.<name>, dir, stderr, option.<name>, depth, nodes and movetime, plus warmup.depth,
+// warmup.nodes and warmup.movetime. The name only comes from the [name] line.
+
+#define MAX_ENGINE_OPTIONS 32
+
+typedef struct {
+    const char *name;
+    engine_launch launch;
+    const char *options[MAX_ENGINE_OPTIONS];    // "<name>=<value>", sent with setoption
+    int option_count;
+    search_limits limits;   // for every search; cow_match adds the clock to these
+    search_limits warmup;   // all zero for no warm-up
+} engine_profile;
+
+typedef struct {
+    engine_profile *profiles;
+    int count;
+    char *text;             // the file, cut up in place; every string in the profiles points into it
+} engine_profiles;
+
+// applies one "key=value" setting, keeping pointers into it; false for a key it doesn't know or
+// one too many of something
+bool set_engine_profile(engine_profile *profile, const char *setting);
+// true when the limits stop a search by themselves, without a clock
+bool has_search_limits(const search_limits *limits);
+// writes the setoption command for one "<name>=<value>" option, ending in a newline
+void uci_option_command(const char *option, char cmd[UCI_LINE_MAX]);
+
+// false, after saying why, if the file can't be read, has a line that isn't a setting or has a
+// profile without a cmd
+bool load_engine_profiles(engine_profiles *set, const char *path);
+void free_engine_profiles(engine_profiles *set);
+// the profile with the given name, or the first one for a NULL name; NULL if there's no such profile
+const engine_profile *find_engine_profile(const engine_profiles *set, const char *name);
+
+#endif //ENGINE_PROFILE_H
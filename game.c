@@ -3,6 +3,7 @@
 #include <math.h>
 #include <dirent.h>
 #include <stdbool.h>
+#include <ctype.h>
 #include <unistd.h>
 
 #ifdef __JETBRAINS_IDE__
@@ -43,9 +44,15 @@ typedef HMM_Mat4 hmm_mat4;
 #include "utarray.h"
 //#include "map_defs.h"
 #include "uci.h"
-#include "str.h"
 #include "chess_types.h"
 #include "moves.h"
+#include "bitboard.h"
+#include "termination.h"
+#include "uci_info.h"
+#include "engine_pool.h"
+#include "engine_channel.h"
+#include "engine_profile.h"
+#include "position_cmd.h"
 #include "easing.h"
 #include "data.h"
 
@@ -56,6 +63,10 @@ const uint32_t MODIFIER_KEY = SAPP_MODIFIER_CTRL;
 #endif
 
 const double move_time_ms = 500.0;
+// past these the engine is taken to be stuck and gets restarted; a movetime search gets its
+// movetime on top
+const int search_timeout_ms = 60000;
+const int stop_timeout_ms = 5000;
 
 typedef struct {
     v2i pos;
@@ -119,12 +130,22 @@ const u_int32_t DR = 0x00000004;
 const u_int32_t DD = 0x00000008;
 
 typedef enum {
+    STARTING_ENGINE,
     AWAITING_MOVE,
     MOVING_PLAYER,
+    AWAITING_OPPONENT,
     MOVING_OPPONENT,
     CHECKMATE,
+    STALEMATE,
+    DRAW,
 } GameStatus;
 
+// what the engine pool found for one position of an analysed game
+typedef struct {
+    bool done;
+    analysis_result result;
+} ply_analysis;
+
 static struct {
     int screen_w;
     int screen_h;
@@ -146,11 +167,30 @@ static struct {
     int sprite_size;
     int sprite_cols;
     int sprite_rows;
-    uci_client client;
+    const char *profiles_path;  // engine profiles from -engines, NULL to look for engines.conf
+    const char *profile_name;   // from -engine, NULL for the first profile in the file
+    engine_profiles profiles;
+    engine_profile profile;     // the engine being played, and the one used for analysis
+    engine_channel engine;
+    bool warming_up;        // the profile's warm-up search is running, so the game hasn't started
+    bool replay_search;     // the engine was lost mid-search, so its replacement has to search again
+    position_cmd position;  // what the engine was last told about the game, extended each turn
+    int searches_pending;   // go commands sent whose bestmove hasn't come back yet
+    char expected_reply[6]; // the player's move the engine expects next, empty when it didn't say
+    bool pondering;         // the engine is searching on ponder_move while the player thinks
+    char ponder_move[6];
+    uci_info engine_info;   // the latest of everything the engine has reported about its search
+    int search_id;          // counts go commands, so info can be tied to the search it came from
+    int engine_info_search; // the search_id engine_info was reported by, 0 when it's empty
+    engine_pool analysis_pool;  // started the first time a game is analysed
+    bool analysis_pool_started;
+    ply_analysis *analysis; // one per position of the analysed game, by ply
+    int analysis_len;
     bool white_move;
     move_t cur_move;
     game_t game;
     GameStatus status;
+    Termination termination;
     uint64_t delta_time;
     uint64_t event_time;
     bool player_is_black;
@@ -335,10 +375,6 @@ v2i tile_id_to_row_col(int tile_id) {
     return v;
 }
 
-void init_board() {
-    copy_board(state.game.board, initial_board);
-}
-
 void clear_move(move_t *m) {
     m->from.x = -1;
     m->from.y = -1;
@@ -354,113 +390,275 @@ bool moved_to(move_t m) {
     return (m.to.x >= 0 && m.to.y >= 0);
 }
 
-void move_rook_if_castle() {
-    if (is_move_castle(state.cur_move)) {
-        // also move the rook
-        v2i rook_from = { .x = (state.cur_move.from.x < state.cur_move.to.x) ? 7 : 0, .y = state.cur_move.from.y };
-        v2i rook_to = { .x = (state.cur_move.from.x < state.cur_move.to.x) ? 5 : 3, .y = state.cur_move.from.y };
-        PieceColor color = color_at(state.game.board, rook_from.x, rook_from.y);
-        int piece_id = (color == WHITE) ? ROOK_W : ROOK_B;
-        set_board(state.game.board, rook_to, piece_id);
-        unset_board(state.game.board, rook_from);
-    }
-}
-
-void remove_pawn_if_en_passant() {
-    if (is_move_en_passant(state.game.board, state.cur_move)) {
-        int dy = (state.cur_move.from.y - state.cur_move.to.y) / abs(state.cur_move.from.y - state.cur_move.to.y);
-        v2i pos = { .x = state.cur_move.to.x, .y = state.cur_move.to.y + dy };
-        unset_board(state.game.board, pos);
-    }
+bool is_game_over() {
+    return state.status == CHECKMATE || state.status == STALEMATE || state.status == DRAW;
 }
 
 void complete_move(move_t m) {
-    utarray_push_back(state.game.moves, &m);
-    remove_pawn_if_en_passant(); // this has to happen before making the move
-    set_board(state.game.board, m.to, m.piece_id);
-    move_rook_if_castle();
-    PieceColor moved_color = color_at(state.game.board, m.to.x, m.to.y);
-    PieceColor other_color = (moved_color == WHITE) ? BLACK : WHITE;
-    if (is_checkmate(&state.game, other_color)) {
-        state.status = CHECKMATE;
+    make_move(&state.game, m);
+    state.termination = game_termination(&state.game);
+    switch (state.termination) {
+        case TERM_NONE: break;
+        case TERM_CHECKMATE: state.status = CHECKMATE; break;
+        case TERM_STALEMATE: state.status = STALEMATE; break;
+        default: state.status = DRAW; break;
     }
 }
 
 void complete_cur_move() {
     if (!moved_from(state.cur_move) && !moved_to(state.cur_move)) return;
     complete_move(state.cur_move);
-    /*
-    utarray_push_back(state.game.moves, &state.cur_move);
-    remove_pawn_if_en_passant(); // this has to happen before making the move
-    set_board(state.game.board, state.cur_move.to, state.cur_move.piece_id);
-    move_rook_if_castle();
-    PieceColor moved_color = color_at(state.game.board, state.cur_move.to.x, state.cur_move.to.y);
-    PieceColor other_color = (moved_color == WHITE) ? BLACK : WHITE;
-    if (is_checkmate(&state.game, other_color)) {
-        state.status = CHECKMATE;
-    }
-    */
     clear_move(&state.cur_move);
 }
 
+// called right before every go: the panel starts over with each search, like the pool's results
+// do, and whatever the engine reports from here on belongs to this one
+void begin_search() {
+    memset(&state.engine_info, 0, sizeof state.engine_info);
+    state.engine_info_search = 0;
+    state.search_id++;
+}
+
 void initiate_engine_move() {
-    int alen = utarray_len(state.game.moves);
-    const char *prefix = "position startpos moves ";
-    char cmd[(alen * 5)+26];
-    char *c = cmd;
-    strcpy(c, prefix);
-    c += strlen(prefix);
-    int i = 0;
-    for (move_t *m=(move_t *)utarray_front(state.game.moves); m != NULL; m=(move_t *)utarray_next(state.game.moves, m)) {
-        c[i++] = files[m->from.x];
-        c[i++] = ranks[m->from.y];
-        c[i++] = files[m->to.x];
-        c[i++] = ranks[m->to.y];
-        c[i++] = ' ';
+    if (state.pondering) {
+        state.pondering = false;
+        char mstr[6];
+        history_move_str(&state.game, 1, mstr);
+        if (strcmp(mstr, state.ponder_move) == 0) {
+            // the search that's already running is on this position, so it only has to finish
+            engine_channel_send(&state.engine, "ponderhit\n");
+            engine_channel_hurry(&state.engine, UCI_EVENT_BESTMOVE, search_timeout_ms + state.profile.limits.movetime);
+            state.status = AWAITING_OPPONENT;
+            return;
+        }
+        // its bestmove is for the wrong position; the search below is pending by the time it
+        // comes back, so it gets ignored
+        engine_channel_send(&state.engine, "stop\n");
+        engine_channel_hurry(&state.engine, UCI_EVENT_BESTMOVE, stop_timeout_ms);
+    }
+    const char *cmd = position_cmd_update(&state.position, &state.game);
+    printf("%s", cmd);
+    engine_channel_send(&state.engine, cmd);
+    char go[UCI_GO_MAX];
+    uci_go_command(&state.profile.limits, go);
+    begin_search();
+    engine_channel_request(&state.engine, go, UCI_EVENT_BESTMOVE, search_timeout_ms + state.profile.limits.movetime);
+    state.searches_pending++;
+    // the reply comes back through handle_engine_events
+    state.status = AWAITING_OPPONENT;
+}
+
+// the engine's answer to the last go command; anything else is a search that was cut short
+void engine_move_ready(const uci_event *ev) {
+    if (--state.searches_pending > 0 || state.status != AWAITING_OPPONENT) return;
+    // only take the engine's word for it if the move is legal here
+    const packed_move_t pm = str_to_packed_move(&state.game, ev->bestmove);
+    if (pm == MOVE_NONE) {
+        fprintf(stderr, "-=-= engine played an illegal move: %s\n", ev->line);
+        state.status = AWAITING_MOVE;
+        return;
+    }
+    state.cur_move = unpack_move(&state.game, pm);
+    state.status = MOVING_OPPONENT;
+    state.event_time = 0;
+    // what to ponder on: the engine's own guess, or failing that the reply in the pv of this same
+    // search (the bestmove that got this far answers the latest go)
+    snprintf(state.expected_reply, sizeof(state.expected_reply), "%s", ev->ponder);
+    const uci_info *info = &state.engine_info;
+    if (state.expected_reply[0] == '\0' && state.engine_info_search == state.search_id &&
+        (info->fields & INFO_PV) && info->pv_len >= 2 && info->pv[0] == pm) {
+        packed_move_to_str(info->pv[1], state.expected_reply);
+    }
+}
+
+// has the engine search the player's expected reply while the player thinks. If the player
+// makes that move, ponderhit turns it into the real search, which by then is usually done.
+void start_pondering() {
+    state.pondering = false;
+    if (state.expected_reply[0] == '\0') return;
+    const packed_move_t pm = str_to_packed_move(&state.game, state.expected_reply);
+    state.expected_reply[0] = '\0';
+    if (pm == MOVE_NONE) return;
+    // the position command runs one move ahead of the game; it starts over if the player
+    // plays something else
+    make_move(&state.game, unpack_move(&state.game, pm));
+    history_move_str(&state.game, 1, state.ponder_move);
+    const char *cmd = position_cmd_update(&state.position, &state.game);
+    unmake_move(&state.game);
+    printf("%s", cmd);
+    engine_channel_send(&state.engine, cmd);
+    char go[UCI_GO_MAX];
+    uci_go_command(&state.profile.limits, go);
+    char ponder_go[UCI_GO_MAX + 8];
+    snprintf(ponder_go, sizeof(ponder_go), "go ponder%s", go + strlen("go"));
+    begin_search();
+    // no deadline until ponderhit, the probes are enough to tell it's still alive
+    engine_channel_request(&state.engine, ponder_go, UCI_EVENT_BESTMOVE, 0);
+    state.searches_pending++;
+    state.pondering = true;
+}
+
+// folds an info line from the search in progress into what the analysis panel shows
+void engine_info_ready(const uci_event *ev) {
+    // info from a search that was stopped is about some other position
+    if (state.searches_pending != 1 || state.status != AWAITING_OPPONENT) return;
+    uci_info info;
+    if (!parse_uci_info(&state.game, ev->line, &info)) return;
+    // only the best line of a multipv search is shown, but every line counts for the totals
+    if ((info.fields & INFO_MULTIPV) && info.multipv > 1) info.fields &= ~INFO_LINE_FIELDS;
+    merge_uci_info(&state.engine_info, &info);
+    state.engine_info_search = state.search_id;
+}
+
+// a search before the game starts, so that the engine has loaded its network and touched its hash
+// by the first real move, which would otherwise take far longer than the ones after it
+void warm_up_engine() {
+    char go[UCI_GO_MAX];
+    uci_go_command(&state.profile.warmup, go);
+    engine_channel_send(&state.engine, "position startpos\n");
+    begin_search();
+    engine_channel_request(&state.engine, go, UCI_EVENT_BESTMOVE, search_timeout_ms + state.profile.warmup.movetime);
+    state.warming_up = true;
+}
+
+// takes whatever the engine has said since the last frame, never waiting for more
+void handle_engine_events() {
+    uci_event ev;
+    while (engine_channel_next(&state.engine, &ev, 0)) {
+        // info lines go to the panel instead, there are far too many of them to print
+        if (ev.type != UCI_EVENT_EOF && ev.type != UCI_EVENT_INFO) printf("%s\n", ev.line);
+        switch (ev.type) {
+            case UCI_EVENT_UCIOK: {
+                for (int i=0; i<state.profile.option_count; i++) {
+                    char cmd[UCI_LINE_MAX];
+                    uci_option_command(state.profile.options[i], cmd);
+                    engine_channel_send(&state.engine, cmd);
+                }
+                engine_channel_send(&state.engine, "setoption name Ponder value true\n");
+                engine_channel_send(&state.engine, "ucinewgame\n");
+                engine_channel_request(&state.engine, "isready\n", UCI_EVENT_READYOK, CHANNEL_HANDSHAKE_TIMEOUT_MS);
+                break;
+            }
+            case UCI_EVENT_READYOK: {
+                if (state.status == STARTING_ENGINE) {
+                    if (has_search_limits(&state.profile.warmup)) {
+                        warm_up_engine();
+                    } else {
+                        state.status = AWAITING_MOVE;
+                    }
+                }
+                if (state.replay_search) {
+                    state.replay_search = false;
+                    initiate_engine_move();
+                }
+                break;
+            }
+            case UCI_EVENT_INFO: {
+                engine_info_ready(&ev);
+                break;
+            }
+            case UCI_EVENT_BESTMOVE: {
+                if (state.warming_up) {
+                    // the game starts from a clean slate, but with the engine's memory all paged in
+                    state.warming_up = false;
+                    engine_channel_send(&state.engine, "ucinewgame\n");
+                    state.status = AWAITING_MOVE;
+                    break;
+                }
+                engine_move_ready(&ev);
+                break;
+            }
+            case UCI_EVENT_EOF: {
+                fprintf(stderr, "-=-= %s\n", ev.line);
+                // nothing the old engine was asked is going to come back
+                state.searches_pending = 0;
+                state.pondering = false;
+                state.warming_up = false;
+                if (!state.engine.running) {
+                    fprintf(stderr, "-=-= giving up on the engine\n");
+                    break;
+                }
+                // the new one goes through the handshake above and then picks up the search
+                state.replay_search = (state.status == AWAITING_OPPONENT);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
     }
-    c[i++] = '\n';
-    c[i++] = '\0';
-    printf("%s\n", cmd);
-    fputs(cmd, state.client.out);
-    fflush(state.client.out);
-    fputs("go depth 3\n", state.client.out);
-    fflush(state.client.out);
-    str_t line = str_init();
-    while (true) {
-        str_getline(&line, state.client.in);
-        printf("%s\n", line.buf);
-        if (str_starts_with(line.buf, "bestmove")) break;
+}
+
+void analysis_ready(const analysis_result *result, void *ctx) {
+    (void)ctx;
+    if (result->id < 0 || result->id >= state.analysis_len) return;
+    state.analysis[result->id].done = true;
+    state.analysis[result->id].result = *result;
+}
+
+// hands every position of the game so far to the engine pool, which searches them side by side
+// with the profile's limits
+void analyse_game() {
+    if (!state.analysis_pool_started) {
+        state.analysis_pool_started = engine_pool_start(&state.analysis_pool, &state.profile, 0, analysis_ready,
+            NULL);
+        if (!state.analysis_pool_started) return;
     }
-    const char *emove = str_prefix(line.buf, "bestmove ");
-    if (emove) {
-        move_t m = str_to_move(state.game.board, emove);
-        state.cur_move.piece_id = state.game.board[xy_to_board_idx(m.from.x, m.from.y)];
-        state.cur_move.from.x = m.from.x;
-        state.cur_move.from.y = m.from.y;
-        state.cur_move.to.x = m.to.x;
-        state.cur_move.to.y = m.to.y;
-        unset_board(state.game.board, state.cur_move.from);
+    const int plies = utarray_len(state.game.undo);
+    free(state.analysis);
+    state.analysis = calloc(plies + 1, sizeof(ply_analysis));
+    state.analysis_len = plies + 1;
+    for (int ply=0; ply<=plies; ply++) {
+        analysis_job job = { .id = ply, .limits = state.profile.limits };
+        save_fen_at(&state.game, plies - ply, job.fen);
+        engine_pool_submit(&state.analysis_pool, &job);
     }
 }
 
+// plays a list of UCI moves from the start position, or from a FEN given first ("<fen> moves ...")
 void play_opening(const char *opening_moves_str) {
-    init_board();
-    utarray_clear(state.game.moves);
-    size_t len = strlen(opening_moves_str);
-    char *s = (char *)opening_moves_str;
-    while (s < opening_moves_str+len) {
-        move_t m = str_to_move(state.game.board, s);
-        complete_move(m);
-        unset_board(state.game.board, m.from);
-        s += 5;
+    // a search on the old position is still running; its bestmove gets ignored when it arrives
+    if (state.searches_pending > 0) {
+        engine_channel_send(&state.engine, "stop\n");
+        engine_channel_hurry(&state.engine, UCI_EVENT_BESTMOVE, stop_timeout_ms);
+    }
+    state.pondering = false;
+    state.replay_search = false;
+    state.expected_reply[0] = '\0';
+    state.status = AWAITING_MOVE;
+    state.termination = TERM_NONE;
+    const char *s = opening_moves_str;
+    while (isspace(*s)) s++;
+    if (strchr(s, '/') != NULL) {
+        if (!load_fen(&state.game, s)) {
+            fprintf(stderr, "-=-= invalid fen: %s\n", s);
+            reset_game(&state.game);
+        }
+        const char *moves = strstr(s, "moves");
+        s = (moves != NULL) ? moves + strlen("moves") : s + strlen(s);
+    } else {
+        reset_game(&state.game);
+    }
+    // moves are separated by any amount of whitespace and may carry a promotion letter
+    char mstr[8];
+    int n = 0;
+    while (sscanf(s, " %7s%n", mstr, &n) == 1) {
+        s += n;
+        const packed_move_t pm = str_to_packed_move(&state.game, mstr);
+        if (pm == MOVE_NONE) {
+            fprintf(stderr, "-=-= illegal opening move: %s\n", mstr);
+            break;
+        }
+        complete_move(unpack_move(&state.game, pm));
+        if (is_game_over()) break;
     }
     state.event_time = 0;
-    int turn = (utarray_len(state.game.moves) % 2) + ((state.player_is_black) ? 2 : 1);
+    if (is_game_over()) return;
+    const PieceColor player_color = (state.player_is_black) ? BLACK : WHITE;
     clear_move(&state.cur_move);
-    if ((turn % 2) == 0) {
+    if (state.game.to_move != player_color) {
         // engine's move
         initiate_engine_move();
-        state.status = MOVING_OPPONENT;
     } else {
         // player's move
         state.status = AWAITING_MOVE;
@@ -516,7 +714,7 @@ void print_piece(Piece p, const char *prefix) {
 }
 
 void play_test_moves() {
-    init_board();
+    reset_game(&state.game);
     const char *tm[24] = {
         "e2e4",
         "e7e6",
@@ -556,13 +754,32 @@ void play_test_moves() {
         printf("\n-=-= %s %s (%d,%d)-(%d,%d)\n", clr, emove, m.from.x, m.from.y, m.to.x, m.to.y);
         print_piece(from_piece, "from_piece: ");
         print_piece(to_piece, "to_piece: ");
-        utarray_push_back(state.game.moves, &m);
-        state.game.board[tidx] = state.game.board[fidx];
-        state.game.board[fidx] = -1;
+        m.piece_id = state.game.board[fidx];
+        make_move(&state.game, m);
         pc = (pc == WHITE) ? BLACK : WHITE;
     }
 }
 
+// picks the engine to play from the profile file; without one it's lc0 searching to depth 3
+void load_engine_profile() {
+    state.profile = (engine_profile){ .name = "lc0", .launch.exe = "lc0", .limits.depth = 3 };
+    const char *path = (state.profiles_path != NULL) ? state.profiles_path : "engines.conf";
+    // engines.conf is optional, a file given with -engines isn't
+    if (state.profiles_path == NULL && access(path, F_OK) != 0) return;
+    if (!load_engine_profiles(&state.profiles, path)) return;
+    const engine_profile *p = find_engine_profile(&state.profiles, state.profile_name);
+    if (p == NULL) {
+        if (state.profile_name != NULL) {
+            fprintf(stderr, "-=-= no engine profile named %s in %s\n", state.profile_name, path);
+        } else {
+            fprintf(stderr, "-=-= no engine profiles in %s\n", path);
+        }
+        return;
+    }
+    state.profile = *p;
+    if (!has_search_limits(&state.profile.limits)) state.profile.limits.depth = 3;
+}
+
 static void init(void) {
     srand(4580958);
     stm_setup();
@@ -753,46 +970,22 @@ static void init(void) {
     sg_update_buffer(state.bind_board.index_buffer, &birange);
 
 
-    init_board();
-    UT_icd move_icd = {sizeof(move_t), NULL, NULL, NULL};
-    utarray_new(state.game.moves, &move_icd);
-    const int move_buf_cap = 1024;
-    state.game.avail = malloc(move_buf_cap * sizeof(v2i));
-    state.game.avail_cap = move_buf_cap;
-    //fork_uci_client("stockfish", &state.client);
-    fork_uci_client("lc0", &state.client);
-
-    fputs("uci\n", state.client.out);
-    fflush(state.client.out);
-    str_t line = str_init();
-    while (true) {
-        str_getline(&line, state.client.in);
-        printf("%s\n", line.buf);
-        if (str_starts_with(line.buf, "uciok")) break;
-    }
-    // lc0 maia option
-    // fputs("setoption name WeightsFile value /Users/dmk/code/external/maia-chess/maia_weights/maia-1100.pb.gz\n", state.client.out);
-    // fflush(state.client.out);
-    // stockfish skill options
-    // fputs("setoption name UCI_LimitStrength value true\n", state.client.out);
-    // fflush(state.client.out);
-    // fputs("setoption name UCI_Elo value 1320\n", state.client.out);
-    // fflush(state.client.out);
-
-    fputs("ucinewgame\n", state.client.out);
-    fflush(state.client.out);
-    fputs("isready\n", state.client.out);
-    fflush(state.client.out);
-    line = str_init();
-    while (true) {
-        str_getline(&line, state.client.in);
-        printf("%s\n", line.buf);
-        if (str_starts_with(line.buf, "readyok")) break;
-    }
+    init_bitboards();
+    init_game(&state.game);
+    position_cmd_init(&state.position);
+    load_engine_profile();
+    engine_channel_start(&state.engine, &state.profile.launch);
+    // the rest of the handshake happens in handle_engine_events as the replies come in
+
     clear_move(&state.cur_move);
     state.player_is_black = false;
     state.white_move = true;
-    state.status = AWAITING_MOVE;
+    state.searches_pending = 0;
+    state.pondering = false;
+    state.expected_reply[0] = '\0';
+    state.replay_search = false;
+    state.warming_up = false;
+    state.status = STARTING_ENGINE;
     //play_test_moves();
 }
 
@@ -830,6 +1023,64 @@ bool is_available_move(const game_t *game, v2i pos) {
     return false;
 }
 
+// the score from an info line as text, empty when there wasn't one
+static void score_str(const uci_info *info, char str[48]) {
+    const char *bound = (info->fields & INFO_LOWERBOUND) ? " (lower bound)" :
+        (info->fields & INFO_UPPERBOUND) ? " (upper bound)" : "";
+    if (info->fields & INFO_SCORE_MATE) {
+        sprintf(str, "mate in %d%s", info->score_mate, bound);
+    } else if (info->fields & INFO_SCORE_CP) {
+        sprintf(str, "%+.2f%s", info->score_cp / 100.0, bound);
+    } else {
+        str[0] = '\0';
+    }
+}
+
+// the engine's view of its search, updated as its info lines come in
+static void draw_engine_info(void) {
+    const uci_info *info = &state.engine_info;
+    if (info->fields == 0) return;
+    igSeparator();
+    igText("depth %d/%d", info->depth, info->seldepth);
+    char score[48];
+    score_str(info, score);
+    if (score[0] != '\0') igText("score: %s", score);
+    igText("nodes: %llu  nps: %llu", (unsigned long long)info->nodes, (unsigned long long)info->nps);
+    igText("hashfull: %.1f%%  tbhits: %llu  time: %.1fs", info->hashfull / 10.0,
+        (unsigned long long)info->tbhits, info->time / 1000.0);
+    if (info->pv_len > 0) {
+        char pv[UCI_INFO_MAX_PV * 6];
+        char *c = pv;
+        for (int i=0; i<info->pv_len; i++) {
+            if (i > 0) *c++ = ' ';
+            packed_move_to_str(info->pv[i], c);
+            c += strlen(c);
+        }
+        igTextWrapped("pv: %s", pv);
+    }
+}
+
+// the engine pool's verdict on each position of the analysed game, filled in as it arrives
+static void draw_analysis(void) {
+    if (state.analysis_len == 0) return;
+    igSetNextWindowPos((ImVec2){10, 340}, ImGuiCond_Once, (ImVec2){0,0});
+    igSetNextWindowSize((ImVec2){400, 300}, ImGuiCond_Once);
+    igBegin("analysis", 0, ImGuiWindowFlags_None);
+    for (int i=0; i<state.analysis_len; i++) {
+        const ply_analysis *a = &state.analysis[i];
+        if (!a->done) {
+            igText("ply %d: ...", i);
+        } else if (!a->result.ok) {
+            igText("ply %d: no engine could analyse it", i);
+        } else {
+            char score[48];
+            score_str(&a->result.info, score);
+            igText("ply %d: %s  best %s", i, score, a->result.bestmove[0] ? a->result.bestmove : "(none)");
+        }
+    }
+    igEnd();
+}
+
 static void frame(void) {
     uint64_t lap_time = stm_laptime(&state.delta_time);
     state.event_time += lap_time;
@@ -865,6 +1116,8 @@ static void frame(void) {
         strcpy(state.opening_buf, clip);
         state.input.paste = false;
     }
+    handle_engine_events();
+    if (state.analysis_pool_started) engine_pool_run(&state.analysis_pool, 0);
     // handle user clicking on the board to move pieces
     if (state.status == AWAITING_MOVE && state.input.mouse_clicked) {
         if (state.white_move) {
@@ -881,7 +1134,6 @@ static void frame(void) {
                     state.game.avail_len = 0;
                     state.status = MOVING_PLAYER;
                     state.event_time = 0;
-                    unset_board(state.game.board, state.cur_move.from);
                 } else if (state.game.board[bidx] >= 0) {
                     // printf("calling valid_moves with tile_clicked: %d,%d\n", tc.x, tc.y);
                     // set start position - select piece that player is moving and calculate available moves
@@ -906,13 +1158,22 @@ static void frame(void) {
     if (state.status == MOVING_PLAYER && stm_ms(state.event_time) >= move_time_ms) {
         // complete player move, select opponent move, and start moving opponent piece
         complete_cur_move();
-        initiate_engine_move();
-        state.status = MOVING_OPPONENT;
+        if (!is_game_over()) {
+            initiate_engine_move();
+        } else if (state.pondering) {
+            // the game ended on the player's move, so there's nothing left to search for
+            engine_channel_send(&state.engine, "stop\n");
+            engine_channel_hurry(&state.engine, UCI_EVENT_BESTMOVE, stop_timeout_ms);
+            state.pondering = false;
+        }
         state.event_time = 0;
     } else if (state.status == MOVING_OPPONENT && stm_ms(state.event_time) >= move_time_ms) {
         // complete opponent move and start awaiting player move
         complete_cur_move();
-        state.status = AWAITING_MOVE;
+        if (!is_game_over()) {
+            state.status = AWAITING_MOVE;
+            start_pondering();
+        }
         state.event_time = 0;
     }
 
@@ -924,7 +1185,7 @@ static void frame(void) {
     });
     /*=== UI CODE STARTS HERE ===*/
     igSetNextWindowPos((ImVec2){10,10}, ImGuiCond_Once, (ImVec2){0,0});
-    igSetNextWindowSize((ImVec2){400, 200}, ImGuiCond_Once);
+    igSetNextWindowSize((ImVec2){400, 320}, ImGuiCond_Once);
     igBegin("test_window", 0, ImGuiWindowFlags_None);
     /*
     igBeginGroup();
@@ -938,14 +1199,27 @@ static void frame(void) {
     igText("scroll: %0.2f", state.input.scroll_amt);
     */
     igText("tile clicked: %d, %d", state.input.tile_clicked.x, state.input.tile_clicked.y);
+    if (is_game_over()) {
+        igText("game over: %s", termination_str(state.termination));
+    }
     igInputText("opening", state.opening_buf, 16384, ImGuiInputTextFlags_EscapeClearsAll, NULL, NULL);
-    if (igButton("play opening", (ImVec2){.x = 120, .y = 40})) {
-        int opening_len = strlen(state.opening_buf);
-        if (opening_len > 0) {
-            play_opening(state.opening_buf);
+    // not until the handshake and warm-up are done, or the warm-up's bestmove would be taken for
+    // the engine's move in the new game
+    if (state.status != STARTING_ENGINE && !state.warming_up) {
+        if (igButton("play opening", (ImVec2){.x = 120, .y = 40})) {
+            int opening_len = strlen(state.opening_buf);
+            if (opening_len > 0) {
+                play_opening(state.opening_buf);
+            }
         }
     }
+    // one batch at a time, so results from an earlier one can't land on the wrong ply
+    if (!state.analysis_pool_started || !engine_pool_busy(&state.analysis_pool)) {
+        if (igButton("analyse game", (ImVec2){.x = 120, .y = 40})) analyse_game();
+    }
+    draw_engine_info();
     igEnd();
+    draw_analysis();
     /*=== UI CODE ENDS HERE ===*/
 
     if (state.input.mouse_down) {
@@ -964,8 +1238,11 @@ static void frame(void) {
         }
     }
 
+    const bool moving = (state.status == MOVING_PLAYER || state.status == MOVING_OPPONENT);
     for (int i=0; i<64; i++) {
         const int piece_id = state.game.board[i];
+        // the moving piece is drawn on its way to the end square below
+        if (moving && i == v2i_to_board_idx(state.cur_move.from)) continue;
         if (piece_id >= 0) {
             const int xx = i % 8;
             const int yy = i / 8;
@@ -1037,7 +1314,12 @@ static void cleanup(void) {
     free(state.pbuf.indices);
     free(state.bbuf.verts);
     free(state.bbuf.indices);
-    utarray_free(state.game.moves);
+    engine_channel_stop(&state.engine);
+    if (state.analysis_pool_started) engine_pool_stop(&state.analysis_pool);
+    free(state.analysis);
+    free_game(&state.game);
+    free_engine_profiles(&state.profiles);
+    position_cmd_free(&state.position);
     free(state.opening_buf);
 }
 
@@ -1120,8 +1402,10 @@ static void event_handler(const sapp_event* ev) {
 }
 
 sapp_desc sokol_main(int argc, char* argv[]) {
-    (void)argc;
-    (void)argv;
+    for (int i=1; i<argc - 1; i++) {
+        if (strcmp(argv[i], "-engines") == 0) state.profiles_path = argv[++i];
+        else if (strcmp(argv[i], "-engine") == 0) state.profile_name = argv[++i];
+    }
     state.screen_w = 1280;
     state.screen_h = 800;
     return (sapp_desc){
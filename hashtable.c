@@ -0,0 +1,54 @@
+#include "hashtable.h"
+#include <stdlib.h>
+
+bool hash_table_init(hash_table *ht, size_t size_mb) {
+    const size_t max_entries = (size_mb << 20) / sizeof(hash_entry);
+    ht->entries = NULL;
+    ht->mask = 0;
+    if (max_entries == 0) return false;
+    size_t count = 1;
+    while (count * 2 <= max_entries) count *= 2;
+    ht->entries = calloc(count, sizeof(hash_entry));
+    if (ht->entries == NULL) return false;
+    ht->mask = count - 1;
+    return true;
+}
+
+void hash_table_free(hash_table *ht) {
+    free(ht->entries);
+    ht->entries = NULL;
+    ht->mask = 0;
+}
+
+void hash_table_clear(hash_table *ht) {
+    for (uint64_t i=0; i<=ht->mask; i++) {
+        atomic_store_explicit(&ht->entries[i].check, 0, memory_order_relaxed);
+        atomic_store_explicit(&ht->entries[i].data, 0, memory_order_relaxed);
+    }
+}
+
+// an empty slot is all zeros, which reads back as key 0 with data 0, so key 0 is stored as 1
+static inline uint64_t stored_key(uint64_t key) {
+    return (key == 0) ? 1 : key;
+}
+
+size_t hash_table_size_bytes(const hash_table *ht) {
+    return (ht->entries == NULL) ? 0 : (ht->mask + 1) * sizeof(hash_entry);
+}
+
+bool hash_table_probe(const hash_table *ht, uint64_t key, uint64_t *data) {
+    key = stored_key(key);
+    hash_entry *e = &ht->entries[key & ht->mask];
+    const uint64_t check = atomic_load_explicit(&e->check, memory_order_relaxed);
+    const uint64_t d = atomic_load_explicit(&e->data, memory_order_relaxed);
+    if ((check ^ d) != key) return false;
+    *data = d;
+    return true;
+}
+
+void hash_table_store(hash_table *ht, uint64_t key, uint64_t data) {
+    key = stored_key(key);
+    hash_entry *e = &ht->entries[key & ht->mask];
+    atomic_store_explicit(&e->check, key ^ data, memory_order_relaxed);
+    atomic_store_explicit(&e->data, data, memory_order_relaxed);
+}
@@ -0,0 +1,34 @@
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A fixed-size table from 64-bit keys to 64-bit values that any number of threads can read and
+// write without locks. Each entry stores the value and the key xor'ed with the value; a reader
+// only trusts an entry when the two agree, so a torn write from a racing thread looks like a miss
+// instead of a wrong answer. Stores always replace whatever was in the slot. Key 0 shares an
+// entry with key 1, since a cleared entry would otherwise match it.
+
+typedef struct {
+    _Atomic uint64_t check;     // key ^ data
+    _Atomic uint64_t data;
+} hash_entry;
+
+typedef struct {
+    hash_entry *entries;
+    uint64_t mask;              // entry count - 1; the count is a power of two
+} hash_table;
+
+// sizes the table to the largest power-of-two entry count that fits in size_mb megabytes
+bool hash_table_init(hash_table *ht, size_t size_mb);
+void hash_table_free(hash_table *ht);
+void hash_table_clear(hash_table *ht);
+size_t hash_table_size_bytes(const hash_table *ht);
+
+bool hash_table_probe(const hash_table *ht, uint64_t key, uint64_t *data);
+void hash_table_store(hash_table *ht, uint64_t key, uint64_t data);
+
+#endif //HASHTABLE_H
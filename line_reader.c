@@ -0,0 +1,82 @@
+#include "line_reader.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+bool line_reader_init(line_reader *lr, int fd, size_t cap) {
+    lr->buf = malloc(cap);
+    if (lr->buf == NULL) return false;
+    lr->fd = fd;
+    lr->cap = cap;
+    lr->start = lr->end = lr->scanned = 0;
+    lr->discarding = false;
+    lr->eof = false;
+    return true;
+}
+
+void line_reader_free(line_reader *lr) {
+    free(lr->buf);
+    lr->buf = NULL;
+}
+
+// hands out the bytes [start, start + len) and moves past them plus 'skip' more
+static bool take_line(line_reader *lr, line_view *line, size_t len, size_t skip) {
+    const char *p = lr->buf + lr->start;
+    lr->start += len + skip;
+    lr->scanned = 0;
+    if (len > 0 && p[len - 1] == '\r') len--;
+    line->ptr = p;
+    line->len = len;
+    return true;
+}
+
+bool line_reader_pop(line_reader *lr, line_view *line) {
+    while (true) {
+        const size_t pending = lr->end - lr->start;
+        const char *nl = memchr(lr->buf + lr->start + lr->scanned, '\n', pending - lr->scanned);
+        if (nl == NULL) {
+            lr->scanned = pending;
+            break;
+        }
+        const size_t len = nl - (lr->buf + lr->start);
+        if (!lr->discarding) return take_line(lr, line, len, 1);
+        lr->discarding = false;
+        lr->start += len + 1;
+        lr->scanned = 0;
+    }
+
+    const size_t pending = lr->end - lr->start;
+    if (lr->eof) {
+        // whatever is left never got its newline
+        if (pending == 0 || lr->discarding) return false;
+        return take_line(lr, line, pending, 0);
+    }
+    // no whole line yet, so make room for the next read
+    if (lr->discarding) {
+        // none of it has a newline yet, so it all belongs to the line being skipped
+        lr->start = lr->end = lr->scanned = 0;
+    } else if (lr->end == lr->cap) {
+        if (lr->start == 0) {
+            // one line fills the whole buffer: give back what fits and skip the rest
+            lr->discarding = true;
+            return take_line(lr, line, pending, 0);
+        }
+        memmove(lr->buf, lr->buf + lr->start, pending);
+        lr->start = 0;
+        lr->end = pending;
+    }
+    return false;
+}
+
+ssize_t line_reader_fill(line_reader *lr) {
+    // a zero-length read() would look just like the pipe closing
+    if (lr->end == lr->cap) return 0;
+    const ssize_t n = read(lr->fd, lr->buf + lr->end, lr->cap - lr->end);
+    if (n > 0) {
+        lr->end += n;
+    } else if (n == 0 || (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        lr->eof = true;
+    }
+    return n;
+}
@@ -0,0 +1,43 @@
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Splits what comes down a pipe into lines without going through stdio. Bytes arrive with one
+// read() per buffer-full, newlines are found with memchr, and each line is handed out as a view
+// into the buffer rather than copied anywhere. Only the unfinished line at the end of the buffer
+// ever moves, back to the front to make room for the next read.
+
+typedef struct {
+    const char *ptr;    // not nul terminated
+    size_t len;
+} line_view;
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t start;       // first byte not handed out yet
+    size_t end;         // one past the last byte read
+    size_t scanned;     // bytes from start already known to have no newline
+    bool discarding;    // dropping the rest of a line that didn't fit in the buffer
+    bool eof;
+} line_reader;
+
+// the reader doesn't own fd, so closing it is still up to the caller
+bool line_reader_init(line_reader *lr, int fd, size_t cap);
+void line_reader_free(line_reader *lr);
+
+// The caller waits on the fd itself (with poll or epoll), so nothing here blocks. Pop points
+// 'line' at a whole line already in the buffer, without the newline or a trailing '\r', and
+// returns false when there isn't one. The view is good until the next call. A line longer than
+// the buffer comes back cut off and the rest of it is skipped. Fill does a single read() and
+// returns what read() did. Fill reads nothing and returns 0 while the buffer is full, so pop
+// everything first; that 0 isn't the end of the pipe. After fill sees the pipe close (or fail),
+// pop still hands out what's left and then returns false for good.
+bool line_reader_pop(line_reader *lr, line_view *line);
+ssize_t line_reader_fill(line_reader *lr);
+
+#endif //LINE_READER_H
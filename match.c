@@ -0,0 +1,759 @@
+// cow_match: plays engines against each other, several games at a time, and writes the games out
+// as PGN
+
+#include <ctype.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "moves.h"
+#include "bitboard.h"
+#include "termination.h"
+#include "uci.h"
+#include "uci_info.h"
+#include "line_reader.h"
+#include "position_cmd.h"
+#include "engine_profile.h"
+#include "threadpool.h"
+#include "sprt.h"
+#include "util.h"
+
+#define MAX_ENGINES 16
+#define MAX_PAIRS (MAX_ENGINES * (MAX_ENGINES - 1) / 2)
+// how long an engine gets to answer uci and isready
+#define HANDSHAKE_TIMEOUT_MS 10000
+// how long a warm-up search gets before the engine is taken to be stuck
+#define WARMUP_TIMEOUT_MS 60000
+// how long an engine that ran out of time gets to answer stop before it's killed
+#define STOP_TIMEOUT_MS 1000
+// mate scores are folded into centipawns beyond anything an evaluation reaches
+#define MATE_SCORE 100000
+
+// an engine process owned by one worker, started the first time that worker needs it
+typedef struct {
+    uci_client cli;
+    line_reader lines;
+    bool running;
+} match_engine;
+
+typedef struct {
+    char uci[6];
+    char san[MAX_SAN_LEN];
+} ply_record;
+
+// each worker thread plays one game at a time with its own engines and board
+typedef struct {
+    match_engine engines[MAX_ENGINES];
+    game_t game;
+    UT_array *plies;        // ply_record for every move of the current game, opening included
+    position_cmd position;  // reused from game to game, so it only reallocates as games get longer
+} match_worker;
+
+// adjudicate once the score has stayed inside (draw) or below (resign) 'score' centipawns for
+// 'count' moves in a row; count 0 turns it off
+typedef struct {
+    int movenumber;         // draw only: not before this move number
+    int count;
+    int score;
+} adjudication;
+
+typedef struct {
+    int white, black;       // index into match.engines
+    int round;              // game number, from 1
+    const char *opening;    // NULL for the start position
+} game_setup;
+
+typedef struct {
+    const char *result;     // "1-0", "0-1" or "1/2-1/2"
+    const char *termination;    // the PGN Termination tag
+    char reason[96];
+} game_outcome;
+
+static const UT_icd ply_record_icd = { sizeof(ply_record), NULL, NULL, NULL };
+
+static struct {
+    engine_profile engines[MAX_ENGINES];
+    int engine_count;
+    int pairs[MAX_PAIRS][2];
+    match_stats scores[MAX_PAIRS];  // for the first engine of each pair
+    int8_t *pair_points;    // by game pair: the first engine's half points from whichever game
+                            // of the pair finished first, -1 until one has
+    int pair_count;
+    UT_array *openings;     // strings, as load_opening takes them
+    int games;
+    int concurrency;
+    const char *tc_str;
+    int64_t tc_time;        // milliseconds per game, 0 for no clock
+    int64_t tc_inc;
+    int tc_margin;          // how far past its clock an engine may go and still have its move count
+    int search_timeout;     // milliseconds a search without a clock or movetime may take
+    int max_moves;          // 0 for no limit
+    engine_profiles profiles;   // from -engines, for profile=
+    bool profiles_used;         // an engine points into profiles, so they can't be replaced
+    adjudication draw;
+    adjudication resign;
+    FILE *pgn;
+    match_worker *workers;
+    pthread_mutex_t lock;   // the pgn file, the scores and stdout
+    _Atomic int next_game;  // the next game a worker starts
+    int games_done;
+    bool use_sprt;
+    sprt_config sprt;
+    atomic_bool stop;       // set once the sprt has its answer, so no more games get started
+} match;
+
+// the next thing the engine says, waiting until deadline (a system_msec time, 0 for no limit);
+// 1 for an event, 0 when the deadline passed, -1 when the engine is gone
+static int next_event(match_engine *me, uci_event *ev, int64_t deadline) {
+    line_view line;
+    while (!line_reader_pop(&me->lines, &line)) {
+        if (me->lines.eof) return -1;
+        int timeout = -1;
+        if (deadline > 0) {
+            const int64_t left = deadline - system_msec();
+            if (left <= 0) return 0;
+            timeout = (int)left;
+        }
+        struct pollfd pfd = { .fd = me->cli.in_fd, .events = POLLIN };
+        const int ready = poll(&pfd, 1, timeout);
+        if (ready == 0) return 0;
+        if (ready > 0) line_reader_fill(&me->lines);
+    }
+    const size_t len = min(line.len, sizeof(ev->line) - 1);
+    memcpy(ev->line, line.ptr, len);
+    ev->line[len] = '\0';
+    parse_uci_event(ev);
+    return 1;
+}
+
+// skips everything up to an event of the given type; false if it doesn't come in time
+static bool wait_for_event(match_engine *me, uci_event_type type, int64_t deadline) {
+    uci_event ev;
+    int got;
+    while ((got = next_event(me, &ev, deadline)) > 0 && ev.type != type) {}
+    return got > 0;
+}
+
+static void close_engine(match_engine *me, bool kill_it) {
+    if (!me->running) return;
+    if (kill_it) {
+        kill(me->cli.pid, SIGKILL);
+    } else {
+        uci_send(&me->cli, "quit\n");
+    }
+    fclose(me->cli.out);
+    close(me->cli.in_fd);
+    waitpid(me->cli.pid, NULL, 0);
+    line_reader_free(&me->lines);
+    me->running = false;
+}
+
+static bool start_engine(const engine_profile *cfg, match_engine *me) {
+    if (!spawn_uci_client(&cfg->launch, &me->cli)) return false;
+    if (!line_reader_init(&me->lines, me->cli.in_fd, UCI_READ_BUF_SIZE)) {
+        DIE("failed to allocate the uci line buffer\n");
+    }
+    me->running = true;
+    uci_send(&me->cli, "uci\n");
+    if (!wait_for_event(me, UCI_EVENT_UCIOK, system_msec() + HANDSHAKE_TIMEOUT_MS)) {
+        close_engine(me, true);
+        return false;
+    }
+    for (int i=0; i<cfg->option_count; i++) {
+        char cmd[UCI_LINE_MAX];
+        uci_option_command(cfg->options[i], cmd);
+        uci_send(&me->cli, cmd);
+    }
+    if (has_search_limits(&cfg->warmup)) {
+        char go[UCI_GO_MAX];
+        uci_go_command(&cfg->warmup, go);
+        uci_send(&me->cli, "position startpos\n");
+        uci_send(&me->cli, go);
+        if (!wait_for_event(me, UCI_EVENT_BESTMOVE, system_msec() + WARMUP_TIMEOUT_MS)) {
+            close_engine(me, true);
+            return false;
+        }
+    }
+    return true;
+}
+
+// gets an engine ready for a new game, starting it first if it isn't running
+static bool prepare_engine(const engine_profile *cfg, match_engine *me) {
+    if (!me->running && !start_engine(cfg, me)) return false;
+    uci_send(&me->cli, "ucinewgame\n");
+    uci_send(&me->cli, "isready\n");
+    if (!wait_for_event(me, UCI_EVENT_READYOK, system_msec() + HANDSHAKE_TIMEOUT_MS)) {
+        close_engine(me, true);
+        return false;
+    }
+    return true;
+}
+
+static void play_recorded(game_t *game, packed_move_t pm, UT_array *plies) {
+    ply_record rec;
+    packed_move_to_str(pm, rec.uci);
+    packed_move_to_san(game, pm, rec.san);
+    utarray_push_back(plies, &rec);
+    make_move(game, unpack_move(game, pm));
+}
+
+// sets up a game from an opening: a FEN, a FEN followed by "moves ...", or moves from the start
+// position. The moves are played and recorded, and start_fen gets the position before them.
+static bool load_opening(game_t *game, const char *opening, char start_fen[MAX_FEN_LEN], UT_array *plies) {
+    utarray_clear(plies);
+    const char *s = (opening != NULL) ? opening : "";
+    while (isspace(*s)) s++;
+    if (strchr(s, '/') != NULL) {
+        if (!load_fen(game, s)) return false;
+        const char *moves = strstr(s, "moves");
+        s = (moves != NULL) ? moves + strlen("moves") : s + strlen(s);
+    } else {
+        reset_game(game);
+    }
+    save_fen(game, start_fen);
+    char mstr[8];
+    int n = 0;
+    while (sscanf(s, " %7s%n", mstr, &n) == 1) {
+        s += n;
+        const packed_move_t pm = str_to_packed_move(game, mstr);
+        if (pm == MOVE_NONE) return false;
+        play_recorded(game, pm, plies);
+    }
+    return true;
+}
+
+static void set_result(game_outcome *out, const char *result, const char *termination, const char *reason) {
+    out->result = result;
+    out->termination = termination;
+    snprintf(out->reason, sizeof(out->reason), "%s", reason);
+}
+
+// the side with color index ci lost
+static void set_loss(game_outcome *out, int ci, const char *termination, const char *name, const char *why) {
+    out->result = (ci == 0) ? "0-1" : "1-0";
+    out->termination = termination;
+    snprintf(out->reason, sizeof(out->reason), "%s %s", name, why);
+}
+
+static int score_cp(const uci_info *info) {
+    if (!(info->fields & INFO_SCORE_MATE)) return info->score_cp;
+    return (info->score_mate > 0) ? MATE_SCORE - info->score_mate : -MATE_SCORE - info->score_mate;
+}
+
+static void play_game(match_worker *w, const game_setup *setup, game_outcome *out, char start_fen[MAX_FEN_LEN]) {
+    game_t *game = &w->game;
+    load_opening(game, setup->opening, start_fen, w->plies);
+    const int sides[2] = { setup->white, setup->black };   // by color index
+    for (int ci=0; ci<2; ci++) {
+        const engine_profile *cfg = &match.engines[sides[ci]];
+        if (!prepare_engine(cfg, &w->engines[sides[ci]])) {
+            set_loss(out, ci, "abandoned", cfg->name, "failed to start");
+            return;
+        }
+    }
+    int64_t clocks[2] = { match.tc_time, match.tc_time };
+    int resign_count[2] = { 0, 0 };
+    int draw_count = 0;
+    while (true) {
+        const Termination term = game_termination(game);
+        if (term == TERM_CHECKMATE) {
+            set_loss(out, color_idx(game->to_move), "normal", match.engines[sides[color_idx(game->to_move)]].name,
+                "is checkmated");
+            return;
+        }
+        if (term != TERM_NONE) {
+            set_result(out, "1/2-1/2", "normal", termination_str(term));
+            return;
+        }
+        if (match.max_moves > 0 && (int)utarray_len(w->plies) >= 2 * match.max_moves) {
+            set_result(out, "1/2-1/2", "adjudication", "move limit");
+            return;
+        }
+
+        const int ci = color_idx(game->to_move);
+        const engine_profile *cfg = &match.engines[sides[ci]];
+        match_engine *me = &w->engines[sides[ci]];
+        uci_send(&me->cli, position_cmd_update(&w->position, game));
+        search_limits limits = cfg->limits;
+        if (match.tc_time > 0) {
+            limits.wtime = clocks[0];
+            limits.btime = clocks[1];
+            limits.winc = limits.binc = match.tc_inc;
+        }
+        char go[UCI_GO_MAX];
+        uci_go_command(&limits, go);
+        uci_send(&me->cli, go);
+
+        // every search gets a deadline, so an engine that wedges can't hold up the match
+        const int64_t start = system_msec();
+        int64_t deadline = start + match.search_timeout;
+        if (match.tc_time > 0) {
+            deadline = start + clocks[ci] + match.tc_margin;
+        } else if (limits.movetime > 0) {
+            deadline = start + limits.movetime + match.tc_margin;
+        }
+        uci_event ev;
+        uci_info info, last = { 0 };
+        int got;
+        while ((got = next_event(me, &ev, deadline)) > 0 && ev.type != UCI_EVENT_BESTMOVE) {
+            if (ev.type != UCI_EVENT_INFO || !parse_uci_info(game, ev.line, &info)) continue;
+            if ((info.fields & INFO_MULTIPV) && info.multipv > 1) info.fields &= ~INFO_LINE_FIELDS;
+            merge_uci_info(&last, &info);
+        }
+        if (got == 0) {
+            uci_send(&me->cli, "stop\n");
+            // an engine that won't even stop gets replaced before its next game
+            if (!wait_for_event(me, UCI_EVENT_BESTMOVE, system_msec() + STOP_TIMEOUT_MS)) close_engine(me, true);
+            const bool timed = match.tc_time > 0 || limits.movetime > 0;
+            set_loss(out, ci, "time forfeit", cfg->name, timed ? "loses on time" : "stopped answering");
+            return;
+        }
+        if (got < 0) {
+            close_engine(me, true);
+            set_loss(out, ci, "abandoned", cfg->name, "disconnected");
+            return;
+        }
+        if (match.tc_time > 0) {
+            // a move inside the margin still counts, but leaves the clock all but empty
+            clocks[ci] = max(clocks[ci] - (system_msec() - start), (int64_t)1) + match.tc_inc;
+        }
+        const packed_move_t pm = str_to_packed_move(game, ev.bestmove);
+        if (pm == MOVE_NONE) {
+            char why[32];
+            snprintf(why, sizeof(why), "played an illegal move: %s", ev.bestmove[0] ? ev.bestmove : "(none)");
+            set_loss(out, ci, "rules infraction", cfg->name, why);
+            return;
+        }
+        play_recorded(game, pm, w->plies);
+
+        if (!(last.fields & (INFO_SCORE_CP | INFO_SCORE_MATE))) {
+            resign_count[ci] = 0;
+            draw_count = 0;
+            continue;
+        }
+        const int score = score_cp(&last);
+        if (match.resign.count > 0) {
+            resign_count[ci] = (score <= -match.resign.score) ? resign_count[ci] + 1 : 0;
+            if (resign_count[ci] >= match.resign.count) {
+                set_loss(out, ci, "adjudication", cfg->name, "resigns");
+                return;
+            }
+        }
+        if (match.draw.count > 0) {
+            const bool quiet = game->fullmove_number >= match.draw.movenumber && abs(score) <= match.draw.score;
+            draw_count = quiet ? draw_count + 1 : 0;
+            // both engines have to agree, so that's count moves from each of them
+            if (draw_count >= 2 * match.draw.count) {
+                set_result(out, "1/2-1/2", "adjudication", "draw by adjudication");
+                return;
+            }
+        }
+    }
+}
+
+static void write_pgn(FILE *f, const game_setup *setup, const game_outcome *out, const char *start_fen,
+                      UT_array *plies) {
+    char date[16];
+    const time_t now = time(NULL);
+    struct tm tm;
+    strftime(date, sizeof(date), "%Y.%m.%d", localtime_r(&now, &tm));
+    fprintf(f, "[Event \"cow_match\"]\n[Site \"?\"]\n[Date \"%s\"]\n[Round \"%d\"]\n", date, setup->round);
+    fprintf(f, "[White \"%s\"]\n[Black \"%s\"]\n[Result \"%s\"]\n", match.engines[setup->white].name,
+        match.engines[setup->black].name, out->result);
+    if (strcmp(start_fen, START_FEN) != 0) fprintf(f, "[SetUp \"1\"]\n[FEN \"%s\"]\n", start_fen);
+    fprintf(f, "[TimeControl \"%s\"]\n[PlyCount \"%u\"]\n[Termination \"%s\"]\n\n",
+        (match.tc_time > 0) ? match.tc_str : "-", utarray_len(plies), out->termination);
+
+    char side = 'w';
+    int number = 1;
+    sscanf(start_fen, "%*s %c %*s %*s %*d %d", &side, &number);
+    bool black = (side == 'b');
+    int col = 0;
+    char tok[MAX_SAN_LEN + 16];
+    for (ply_record *p = (ply_record *)utarray_front(plies); ; p = (ply_record *)utarray_next(plies, p)) {
+        if (p == NULL) {
+            snprintf(tok, sizeof(tok), "%s", out->result);
+        } else if (!black) {
+            snprintf(tok, sizeof(tok), "%d. %s", number, p->san);
+        } else if (p == (ply_record *)utarray_front(plies)) {
+            snprintf(tok, sizeof(tok), "%d... %s", number, p->san);
+        } else {
+            snprintf(tok, sizeof(tok), "%s", p->san);
+        }
+        // keep lines under 80 columns
+        const int len = strlen(tok);
+        if (col > 0 && col + 1 + len > 79) {
+            fputc('\n', f);
+            col = 0;
+        }
+        if (col > 0) {
+            fputc(' ', f);
+            col++;
+        }
+        if (p == NULL) {
+            fprintf(f, "{%s} %s\n\n", out->reason, tok);
+            break;
+        }
+        fputs(tok, f);
+        col += len;
+        if (black) number++;
+        black = !black;
+    }
+}
+
+// the score for a pair of engines, with elo and the sprt when there's enough to go on
+static void print_stats(int pair) {
+    const match_stats *ms = &match.scores[pair];
+    const int n = ms->wins + ms->losses + ms->draws;
+    printf("score of %s vs %s: %d - %d - %d (%.1f%%)\n", match.engines[match.pairs[pair][0]].name,
+        match.engines[match.pairs[pair][1]].name, ms->wins, ms->losses, ms->draws,
+        (n > 0) ? 100.0 * (ms->wins + 0.5 * ms->draws) / n : 0.0);
+    // every opening is played from both sides, so the games are scored in pairs
+    elo_estimate est;
+    if (estimate_elo(ms, true, &est)) {
+        printf("elo: %.1f +/- %.1f, los: %.1f%%, pentanomial: %d %d %d %d %d\n", est.elo, est.error, 100.0 * est.los,
+            ms->penta[0], ms->penta[1], ms->penta[2], ms->penta[3], ms->penta[4]);
+    }
+    if (match.use_sprt) {
+        double lower, upper;
+        sprt_bounds(&match.sprt, &lower, &upper);
+        printf("sprt (%.1f, %.1f): llr %.2f (%.2f, %.2f)\n", match.sprt.elo0, match.sprt.elo1,
+            sprt_llr(ms, true, &match.sprt), lower, upper);
+    }
+}
+
+static void play_game_task(void *arg, int worker) {
+    (void)arg;
+    if (atomic_load(&match.stop)) return;
+    // the pool runs the newest task first, so take game numbers in order here instead
+    const int idx = atomic_fetch_add(&match.next_game, 1);
+    // games come in pairs that swap colors over the same opening
+    const int pair = (idx / 2) % match.pair_count;
+    const int first = match.pairs[pair][0];
+    const int second = match.pairs[pair][1];
+    game_setup setup = { .round = idx + 1 };
+    setup.white = (idx % 2 == 0) ? first : second;
+    setup.black = (idx % 2 == 0) ? second : first;
+    const unsigned opening_count = utarray_len(match.openings);
+    if (opening_count > 0) {
+        setup.opening = *(char **)utarray_eltptr(match.openings, (idx / 2 / match.pair_count) % opening_count);
+    }
+
+    match_worker *w = &match.workers[worker];
+    game_outcome out;
+    char start_fen[MAX_FEN_LEN];
+    play_game(w, &setup, &out, start_fen);
+
+    pthread_mutex_lock(&match.lock);
+    if (match.pgn != NULL) {
+        write_pgn(match.pgn, &setup, &out, start_fen, w->plies);
+        fflush(match.pgn);
+    }
+    match_stats *ms = &match.scores[pair];
+    const bool first_white = (setup.white == first);
+    int half_points = 1;
+    if (strcmp(out.result, "1/2-1/2") == 0) {
+        ms->draws++;
+    } else if ((strcmp(out.result, "1-0") == 0) == first_white) {
+        ms->wins++;
+        half_points = 2;
+    } else {
+        ms->losses++;
+        half_points = 0;
+    }
+    int8_t *pp = &match.pair_points[idx / 2];
+    if (*pp < 0) {
+        *pp = half_points;
+    } else {
+        ms->penta[*pp + half_points]++;
+    }
+    match.games_done++;
+    printf("game %d (%s vs %s): %s {%s}, %d/%d done\n", setup.round, match.engines[setup.white].name,
+        match.engines[setup.black].name, out.result, out.reason, match.games_done, match.games);
+    print_stats(pair);
+    if (match.use_sprt && !atomic_load(&match.stop)) {
+        const sprt_result verdict = sprt_test(sprt_llr(ms, true, &match.sprt), &match.sprt);
+        if (verdict != SPRT_CONTINUE) {
+            printf("sprt: %s accepted, stopping\n", (verdict == SPRT_ACCEPT_H1) ? "H1" : "H0");
+            atomic_store(&match.stop, true);
+        }
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&match.lock);
+}
+
+static bool load_openings(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return false;
+    game_t game;
+    init_game(&game);
+    UT_array *plies;
+    utarray_new(plies, &ply_record_icd);
+    char line[4096];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        const char *s = line;
+        while (isspace(*s)) s++;
+        if (*s == '\0' || *s == '#') continue;
+        char fen[MAX_FEN_LEN];
+        if (!load_opening(&game, s, fen, plies)) {
+            fprintf(stderr, "skipping bad opening: %s\n", s);
+            continue;
+        }
+        utarray_push_back(match.openings, &s);
+    }
+    utarray_free(plies);
+    free_game(&game);
+    fclose(f);
+    return true;
+}
+
+// reads key=value arguments after argv[*i] until the next flag; false on a key it doesn't know.
+// profile= starts over from a profile read with -engines, sharing its strings.
+static bool parse_engine_args(int argc, char *argv[], int *i, engine_profile *cfg) {
+    while (*i + 1 < argc && argv[*i + 1][0] != '-') {
+        const char *arg = argv[++*i];
+        if (strncmp(arg, "profile=", 8) == 0) {
+            const engine_profile *p = find_engine_profile(&match.profiles, arg + 8);
+            if (p == NULL) {
+                fprintf(stderr, "no engine profile named %s\n", arg + 8);
+                return false;
+            }
+            *cfg = *p;
+            match.profiles_used = true;
+        } else if (!set_engine_profile(cfg, arg)) {
+            fprintf(stderr, "unknown engine setting: %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_adjudication(int argc, char *argv[], int *i, adjudication *adj) {
+    while (*i + 1 < argc && argv[*i + 1][0] != '-') {
+        const char *arg = argv[++*i];
+        if (strncmp(arg, "movenumber=", 11) == 0) {
+            adj->movenumber = atoi(arg + 11);
+        } else if (strncmp(arg, "movecount=", 10) == 0) {
+            adj->count = atoi(arg + 10);
+        } else if (strncmp(arg, "score=", 6) == 0) {
+            adj->score = atoi(arg + 6);
+        } else {
+            fprintf(stderr, "unknown adjudication setting: %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_sprt(int argc, char *argv[], int *i, sprt_config *sprt) {
+    while (*i + 1 < argc && argv[*i + 1][0] != '-') {
+        const char *arg = argv[++*i];
+        if (strncmp(arg, "elo0=", 5) == 0) {
+            sprt->elo0 = atof(arg + 5);
+        } else if (strncmp(arg, "elo1=", 5) == 0) {
+            sprt->elo1 = atof(arg + 5);
+        } else if (strncmp(arg, "alpha=", 6) == 0) {
+            sprt->alpha = atof(arg + 6);
+        } else if (strncmp(arg, "beta=", 5) == 0) {
+            sprt->beta = atof(arg + 5);
+        } else {
+            fprintf(stderr, "unknown sprt setting: %s\n", arg);
+            return false;
+        }
+    }
+    return sprt->elo1 > sprt->elo0 && sprt->alpha > 0 && sprt->alpha < 1 && sprt->beta > 0 && sprt->beta < 1;
+}
+
+// -each settings go under every engine's own, which win where both set something
+static void apply_each(engine_profile *cfg, const engine_profile *each) {
+    engine_launch *l = &cfg->launch;
+    if (l->exe == NULL) l->exe = each->launch.exe;
+    if (l->cwd == NULL) l->cwd = each->launch.cwd;
+    if (l->stderr_path == NULL) l->stderr_path = each->launch.stderr_path;
+    // -each arguments come first; environment settings are applied in order, so the engine's win
+    const int own_args = min(l->arg_count, UCI_MAX_ARGS - each->launch.arg_count);
+    memmove(l->args + each->launch.arg_count, l->args, own_args * sizeof(l->args[0]));
+    memcpy(l->args, each->launch.args, each->launch.arg_count * sizeof(l->args[0]));
+    l->arg_count = own_args + each->launch.arg_count;
+    const int own_env = min(l->env_count, UCI_MAX_ENV - each->launch.env_count);
+    memmove(l->env + each->launch.env_count, l->env, own_env * sizeof(l->env[0]));
+    memcpy(l->env, each->launch.env, each->launch.env_count * sizeof(l->env[0]));
+    l->env_count = own_env + each->launch.env_count;
+    if (cfg->limits.depth == 0) cfg->limits.depth = each->limits.depth;
+    if (cfg->limits.nodes == 0) cfg->limits.nodes = each->limits.nodes;
+    if (cfg->limits.movetime == 0) cfg->limits.movetime = each->limits.movetime;
+    if (!has_search_limits(&cfg->warmup)) cfg->warmup = each->warmup;
+    const int own = min(cfg->option_count, MAX_ENGINE_OPTIONS - each->option_count);
+    memmove(cfg->options + each->option_count, cfg->options, own * sizeof(cfg->options[0]));
+    memcpy(cfg->options, each->options, each->option_count * sizeof(cfg->options[0]));
+    cfg->option_count = own + each->option_count;
+    if (cfg->name == NULL) cfg->name = l->exe;
+}
+
+static void usage(const char *exe) {
+    fprintf(stderr, "usage: %s -engine cmd=<exe> [arg=<arg> ...] [env.<name>=<value>] [dir=<dir>] "
+        "[stderr=<file>]\n", exe);
+    fprintf(stderr, "                 [name=<name>] [option.<name>=<value>] [depth=<n>] [nodes=<n>] [movetime=<ms>]\n");
+    fprintf(stderr, "                 [warmup.depth=<n>] [warmup.nodes=<n>] [warmup.movetime=<ms>]\n");
+    fprintf(stderr, "         [-engines <profile file> -engine profile=<name> [<engine settings>]]\n");
+    fprintf(stderr, "         -engine ... [-engine ...] [-each <engine settings>]\n");
+    fprintf(stderr, "         [-games n] [-concurrency n] [-tc <seconds>[+<increment>]] [-tcmargin ms] [-timeout ms]\n");
+    fprintf(stderr, "         [-openings file] [-maxmoves n] [-pgn file]\n");
+    fprintf(stderr, "         [-draw movenumber=<n> movecount=<n> score=<cp>] [-resign movecount=<n> score=<cp>]\n");
+    fprintf(stderr, "         [-sprt elo0=<elo> elo1=<elo> alpha=<p> beta=<p>]\n");
+    fprintf(stderr, "  every pair of engines plays -games games (default 2), in pairs with colors reversed\n");
+    fprintf(stderr, "  over the same opening; openings are one per line, as a FEN, a FEN followed by\n");
+    fprintf(stderr, "  \"moves ...\", or moves from the start position\n");
+    fprintf(stderr, "  -concurrency games run at once (default 1), each on its own copy of the engines\n");
+    fprintf(stderr, "  an engine that goes past its clock or movetime by -tcmargin (default 100), or that searches\n");
+    fprintf(stderr, "  for longer than -timeout (default 60000) without either, forfeits the game, and is\n");
+    fprintf(stderr, "  restarted if it doesn't answer stop\n");
+    fprintf(stderr, "  -sprt (two engines only; default 0, 5, 0.05, 0.05) stops early once the first engine\n");
+    fprintf(stderr, "  is shown to gain at least elo1 or no more than elo0; -games is then the most it plays\n");
+}
+
+int main(int argc, char *argv[]) {
+    // the openings are checked as they're read, and that needs the attack tables
+    init_bitboards();
+    engine_profile each = { 0 };
+    match.games = 2;
+    match.concurrency = 1;
+    match.sprt = (sprt_config){ .elo0 = 0, .elo1 = 5, .alpha = 0.05, .beta = 0.05 };
+    match.tc_margin = 100;
+    match.search_timeout = 60000;
+    utarray_new(match.openings, &ut_str_icd);
+    const char *pgn_path = NULL;
+    for (int i=1; i<argc; i++) {
+        bool ok = true;
+        if (strcmp(argv[i], "-engine") == 0) {
+            ok = match.engine_count < MAX_ENGINES &&
+                parse_engine_args(argc, argv, &i, &match.engines[match.engine_count++]);
+        } else if (strcmp(argv[i], "-engines") == 0 && i + 1 < argc) {
+            const char *path = argv[++i];
+            if (match.profiles_used) {
+                fprintf(stderr, "-engines has to come before any engine that uses profile=\n");
+                return EXIT_FAILURE;
+            }
+            free_engine_profiles(&match.profiles);
+            if (!load_engine_profiles(&match.profiles, path)) return EXIT_FAILURE;
+        } else if (strcmp(argv[i], "-each") == 0) {
+            ok = parse_engine_args(argc, argv, &i, &each);
+        } else if (strcmp(argv[i], "-games") == 0 && i + 1 < argc) {
+            match.games = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-concurrency") == 0 && i + 1 < argc) {
+            match.concurrency = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-tc") == 0 && i + 1 < argc) {
+            match.tc_str = argv[++i];
+            double secs = 0, inc = 0;
+            ok = sscanf(match.tc_str, "%lf+%lf", &secs, &inc) >= 1 && secs > 0;
+            match.tc_time = (int64_t)(secs * 1000);
+            match.tc_inc = (int64_t)(inc * 1000);
+        } else if (strcmp(argv[i], "-tcmargin") == 0 && i + 1 < argc) {
+            match.tc_margin = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-timeout") == 0 && i + 1 < argc) {
+            match.search_timeout = atoi(argv[++i]);
+            ok = match.search_timeout > 0;
+        } else if (strcmp(argv[i], "-openings") == 0 && i + 1 < argc) {
+            const char *path = argv[++i];
+            if (!load_openings(path)) {
+                fprintf(stderr, "can't read openings from %s\n", path);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-maxmoves") == 0 && i + 1 < argc) {
+            match.max_moves = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-pgn") == 0 && i + 1 < argc) {
+            pgn_path = argv[++i];
+        } else if (strcmp(argv[i], "-draw") == 0) {
+            ok = parse_adjudication(argc, argv, &i, &match.draw);
+        } else if (strcmp(argv[i], "-resign") == 0) {
+            ok = parse_adjudication(argc, argv, &i, &match.resign);
+        } else if (strcmp(argv[i], "-sprt") == 0) {
+            match.use_sprt = true;
+            ok = parse_sprt(argc, argv, &i, &match.sprt);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    for (int e=0; e<match.engine_count; e++) {
+        engine_profile *cfg = &match.engines[e];
+        apply_each(cfg, &each);
+        if (cfg->launch.exe == NULL) {
+            fprintf(stderr, "engine %d has no cmd\n", e + 1);
+            return EXIT_FAILURE;
+        }
+        const search_limits *l = &cfg->limits;
+        if (match.tc_time == 0 && !has_search_limits(l)) {
+            fprintf(stderr, "%s needs -tc or a depth, nodes or movetime limit\n", cfg->name);
+            return EXIT_FAILURE;
+        }
+    }
+    if (match.engine_count < 2 || match.games < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (match.use_sprt && match.engine_count != 2) {
+        fprintf(stderr, "-sprt needs exactly two engines\n");
+        return EXIT_FAILURE;
+    }
+    if (pgn_path != NULL && (match.pgn = fopen(pgn_path, "a")) == NULL) {
+        fprintf(stderr, "can't write to %s\n", pgn_path);
+        return EXIT_FAILURE;
+    }
+
+    for (int a=0; a<match.engine_count; a++) {
+        for (int b=a + 1; b<match.engine_count; b++) {
+            match.pairs[match.pair_count][0] = a;
+            match.pairs[match.pair_count][1] = b;
+            match.pair_count++;
+        }
+    }
+    // from here on it's the total over every pair
+    match.games *= match.pair_count;
+    if (match.concurrency <= 0) match.concurrency = system_cpu_count();
+    printf("engines: %d, games: %d, concurrency: %d\n", match.engine_count, match.games, match.concurrency);
+
+    pthread_mutex_init(&match.lock, NULL);
+    match.pair_points = malloc(match.games / 2 + 1);
+    memset(match.pair_points, -1, match.games / 2 + 1);
+    match.workers = calloc(match.concurrency, sizeof(match_worker));
+    for (int w=0; w<match.concurrency; w++) {
+        init_game(&match.workers[w].game);
+        utarray_new(match.workers[w].plies, &ply_record_icd);
+        position_cmd_init(&match.workers[w].position);
+    }
+    threadpool *pool = pool_create(match.concurrency);
+    for (int g=0; g<match.games; g++) {
+        pool_submit(pool, play_game_task, NULL);
+    }
+    pool_wait(pool);
+    pool_destroy(pool);
+
+    printf("final scores:\n");
+    for (int p=0; p<match.pair_count; p++) print_stats(p);
+
+    for (int w=0; w<match.concurrency; w++) {
+        for (int e=0; e<match.engine_count; e++) close_engine(&match.workers[w].engines[e], false);
+        free_game(&match.workers[w].game);
+        utarray_free(match.workers[w].plies);
+        position_cmd_free(&match.workers[w].position);
+    }
+    free(match.workers);
+    free(match.pair_points);
+    utarray_free(match.openings);
+    free_engine_profiles(&match.profiles);
+    if (match.pgn != NULL) fclose(match.pgn);
+    pthread_mutex_destroy(&match.lock);
+    return EXIT_SUCCESS;
+}
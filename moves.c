@@ -1,7 +1,10 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <ctype.h>
 #include "moves.h"
+#include "bitboard.h"
 
 Piece sprite_to_piece(int sprite) {
     Piece p = {
@@ -23,38 +26,122 @@ void copy_board(int dst[64], const int src[64]) {
     memcpy(dst, src, 64 * sizeof(int));
 }
 
+static void alloc_game(game_t *game) {
+    const int move_buf_cap = 1024;
+    game->avail = malloc(move_buf_cap * sizeof(v2i));
+    game->avail_cap = move_buf_cap;
+    game->avail_len = 0;
+    UT_icd move_icd = {sizeof(move_t), NULL, NULL, NULL};
+    utarray_new(game->moves, &move_icd);
+    UT_icd undo_icd = {sizeof(undo_t), NULL, NULL, NULL};
+    utarray_new(game->undo, &undo_icd);
+    // enough room that searching from a game in progress doesn't have to grow the stack
+    utarray_reserve(game->undo, 1024);
+}
+
+void init_game(game_t *game) {
+    alloc_game(game);
+    game->skip_check_check = false;
+    reset_game(game);
+}
+
+void reset_game(game_t *game) {
+    copy_board(game->board, initial_board);
+    game->to_move = WHITE;
+    game->castling = CASTLE_ALL;
+    game->ep_square = -1;
+    game->halfmove_clock = 0;
+    game->fullmove_number = 1;
+    game->avail_len = 0;
+    utarray_clear(game->moves);
+    utarray_clear(game->undo);
+    sync_position(game);
+}
+
 void copy_game(game_t *game_copy, const game_t *game, bool skip_check_check) {
+    alloc_game(game_copy);
     copy_board(game_copy->board, game->board);
+    game_copy->pos = game->pos;
+    game_copy->to_move = game->to_move;
+    game_copy->castling = game->castling;
+    game_copy->ep_square = game->ep_square;
+    game_copy->halfmove_clock = game->halfmove_clock;
+    game_copy->fullmove_number = game->fullmove_number;
+    memcpy(game_copy->key_ring, game->key_ring, sizeof(game->key_ring));
     game_copy->skip_check_check = skip_check_check;
-    const int move_buf_cap = 1024;
-    game_copy->avail = malloc(move_buf_cap * sizeof(v2i));
-    game_copy->avail_cap = move_buf_cap;
-    game_copy->avail_len = 0;
-    UT_icd move_icd = {sizeof(move_t), NULL, NULL, NULL};
-    utarray_new(game_copy->moves, &move_icd);
-    for (move_t *m=(move_t *)utarray_front(game->moves); m != NULL; m=(move_t *)utarray_next(game->moves, m)) {
-        move_t mc = { .from = {.x = m->from.x, .y = m->from.y}, .to = {.x = m->to.x, .y = m->to.y}, .piece_id = m->piece_id };
-        utarray_push_back(game_copy->moves, &mc);
-    }
-    /*
-    if (utarray_len(game->moves) == 0) {
-        printf("copied game has %d move and parent had %d\n", utarray_len(game_copy->moves), utarray_len(game->moves));
-    }
-    */
+    utarray_concat(game_copy->moves, game->moves);
+    utarray_concat(game_copy->undo, game->undo);
 }
 
 void free_game(game_t *game) {
     utarray_free(game->moves);
+    utarray_free(game->undo);
     free(game->avail);
 }
 
-void set_board(int board[64], v2i pos, int piece_id) {
+static bool is_double_push(move_t m) {
+    return sprite_type(m.piece_id) == PAWN && abs(m.from.y - m.to.y) == 2;
+}
+
+// the castles lost when a piece moves off, or is captured on, a king or rook start square
+static int castle_rights_lost(int sq) {
+    switch (sq) {
+        case 0: return CASTLE_WHITE_LONG;
+        case 4: return CASTLE_WHITE_SHORT | CASTLE_WHITE_LONG;
+        case 7: return CASTLE_WHITE_SHORT;
+        case 56: return CASTLE_BLACK_LONG;
+        case 60: return CASTLE_BLACK_SHORT | CASTLE_BLACK_LONG;
+        case 63: return CASTLE_BLACK_SHORT;
+        default: return 0;
+    }
+}
+
+static int castle_right(PieceColor color, bool shortCastle) {
+    if (color == WHITE) return shortCastle ? CASTLE_WHITE_SHORT : CASTLE_WHITE_LONG;
+    return shortCastle ? CASTLE_BLACK_SHORT : CASTLE_BLACK_LONG;
+}
+
+// the square behind a pawn of 'color' that just moved two squares to 'to', but only when an
+// enemy pawn stands ready to take it, so positions that can't differ don't get different keys
+static int ep_square_after(const position_t *pos, int to, PieceColor color) {
+    const int behind = (color == WHITE) ? to - 8 : to + 8;
+    const PieceColor enemy = opposite_color(color);
+    const bitboard_t capturers = pawn_attacks[color_idx(color)][behind] & pos->pieces[color_idx(enemy)][PAWN];
+    return capturers ? behind : -1;
+}
+
+// the zobrist key of the game computed from scratch: pieces, side to move, castling rights and
+// the file of the en passant square
+uint64_t compute_key(const game_t *game) {
+    uint64_t key = 0;
+    for (int sq=0; sq<64; sq++) {
+        const int sprite = game->pos.mailbox[sq];
+        if (sprite >= 0) key ^= zobrist_pieces[color_idx(sprite_color(sprite))][sprite_type(sprite)][sq];
+    }
+    if (game->to_move == BLACK) key ^= zobrist_side;
+    key ^= zobrist_castle[game->castling];
+    if (game->ep_square >= 0) key ^= zobrist_ep[game->ep_square % 8];
+    return key;
+}
+
+static void record_key(game_t *game) {
+    game->key_ring[utarray_len(game->undo) % KEY_RING_SIZE] = game->pos.key;
+}
+
+void sync_position(game_t *game) {
+    pos_from_board(&game->pos, game->board);
+    game->pos.key = compute_key(game);
+    record_key(game);
+}
+
+void set_board(game_t *game, v2i pos, int piece_id) {
     const int idx = v2i_to_board_idx(pos);
-    board[idx] = piece_id;
+    game->board[idx] = piece_id;
+    pos_put(&game->pos, idx, piece_id);
 }
 
-void unset_board(int board[64], v2i pos) {
-    set_board(board, pos, -1);
+void unset_board(game_t *game, v2i pos) {
+    set_board(game, pos, -1);
 }
 
 Piece piece_at(int board[64], int x, int y) {
@@ -72,22 +159,13 @@ PieceType type_at(int board[64], int x, int y) {
     return (sprite < 0) ? NO_PIECE : ((sprite > 23) ? sprite - 24 : sprite - 8);
 }
 
-int find_king_idx(int board[64], PieceColor color) {
-    int king_idx = -1;
-    for (int i=0; i<64; i++) {
-        int x = i % 8;
-        int y = i / 8;
-        Piece op = piece_at(board, x, y);
-        if (op.type == KING && op.color == color) {
-            king_idx = i;
-            break;
-        }
-    }
-    return king_idx;
+int find_king_idx(const game_t *game, PieceColor color) {
+    if (color == NO_COLOR) return -1;
+    return game->pos.king_sq[color_idx(color)];
 }
 
-v2i find_king_pos(int board[64], PieceColor color) {
-    int king_idx = find_king_idx(board, color);
+v2i find_king_pos(const game_t *game, PieceColor color) {
+    int king_idx = find_king_idx(game, color);
     if (king_idx == -1) return (v2i){ .x = -1, .y = -1 };
     return (v2i){ .x = king_idx % 8, .y = king_idx / 8 };
 }
@@ -97,9 +175,186 @@ v2i find_king_pos(int board[64], PieceColor color) {
 move_t str_to_move(int board[64], const char *mstr) {
     move_t m = { .from = {.x = mstr[0] - 97, .y = mstr[1] - 49}, .to = {.x = mstr[2] - 97, .y = mstr[3] - 49} };
     m.piece_id = board[v2i_to_board_idx(m.from)];
+    // a fifth character picks the piece a pawn promotes to
+    static const char *promo_chars = "qbnr";
+    const char *promo = (mstr[4] != '\0') ? strchr(promo_chars, mstr[4]) : NULL;
+    if (promo != NULL && sprite_type(m.piece_id) == PAWN) {
+        const PieceType promo_types[4] = { QUEEN, BISHOP, KNIGHT, ROOK };
+        m.piece_id = piece_sprite(promo_types[promo - promo_chars], sprite_color(m.piece_id));
+    }
     return m;
 }
 
+// writes the move in UCI notation (e2e4, e7e8q) into str, which needs room for 6 characters
+void move_to_str(int board[64], move_t m, char str[6]) {
+    int i = 0;
+    str[i++] = files[m.from.x];
+    str[i++] = ranks[m.from.y];
+    str[i++] = files[m.to.x];
+    str[i++] = ranks[m.to.y];
+    const int moving = board[v2i_to_board_idx(m.from)];
+    if (sprite_type(moving) == PAWN && m.piece_id != moving) {
+        str[i++] = "kqbnrp"[sprite_type(m.piece_id)];
+    }
+    str[i] = '\0';
+}
+
+// sets the game up from a FEN string; everything after the side to move may be left off
+bool load_fen(game_t *game, const char *fen) {
+    static const char *piece_chars = "kqbnrp";
+    int board[64];
+    for (int i=0; i<64; i++) board[i] = -1;
+    int x = 0;
+    int y = 7;
+    const char *c = fen;
+    while (*c == ' ') c++;
+    for (; *c && *c != ' '; c++) {
+        if (*c == '/') {
+            if (x != 8 || y == 0) return false;
+            x = 0;
+            y--;
+        } else if (*c >= '1' && *c <= '8') {
+            x += *c - '0';
+            if (x > 8) return false;
+        } else {
+            const char *p = strchr(piece_chars, tolower(*c));
+            if (p == NULL || x > 7) return false;
+            board[xy_to_board_idx(x, y)] = piece_sprite(p - piece_chars, isupper(*c) ? WHITE : BLACK);
+            x++;
+        }
+    }
+    if (x != 8 || y != 0) return false;
+    while (*c == ' ') c++;
+    if (*c != 'w' && *c != 'b') return false;
+    const PieceColor to_move = (*c++ == 'w') ? WHITE : BLACK;
+    while (*c == ' ') c++;
+    // in the same order as the CASTLE_* bits
+    static const char *castle_chars = "KQkq";
+    int castling = 0;
+    for (; *c && *c != ' '; c++) {
+        if (*c == '-') continue;
+        const char *r = strchr(castle_chars, *c);
+        if (r == NULL) return false;
+        castling |= 1 << (r - castle_chars);
+    }
+    while (*c == ' ') c++;
+    int ep_square = -1;
+    if (c[0] >= 'a' && c[0] <= 'h' && (c[1] == '3' || c[1] == '6')) {
+        ep_square = xy_to_board_idx(c[0] - 'a', c[1] - '1');
+        c += 2;
+    } else if (*c == '-') {
+        c++;
+    } else if (*c != '\0') {
+        return false;
+    }
+    char *end;
+    const long halfmove_clock = strtol(c, &end, 10);
+    c = end;
+    const long fullmove_number = strtol(c, &end, 10);
+    if (halfmove_clock < 0 || fullmove_number < 0) return false;
+    // the rules don't work without exactly one king a side
+    int kings[2] = { 0, 0 };
+    for (int sq=0; sq<64; sq++) {
+        if (sprite_type(board[sq]) == KING) kings[color_idx(sprite_color(board[sq]))]++;
+    }
+    if (kings[0] != 1 || kings[1] != 1) return false;
+    // drop castling rights the pieces can't back up, so equal positions get equal keys
+    static const int castle_squares[4][2] = { {4, 7}, {4, 0}, {60, 63}, {60, 56} };
+    for (int i=0; i<4; i++) {
+        const PieceColor color = (i < 2) ? WHITE : BLACK;
+        if (board[castle_squares[i][0]] != piece_sprite(KING, color) || board[castle_squares[i][1]] != piece_sprite(ROOK, color)) {
+            castling &= ~(1 << i);
+        }
+    }
+    copy_board(game->board, board);
+    game->to_move = to_move;
+    game->castling = castling;
+    game->ep_square = -1;
+    game->halfmove_clock = (int)halfmove_clock;
+    game->fullmove_number = (fullmove_number > 0) ? (int)fullmove_number : 1;
+    game->avail_len = 0;
+    utarray_clear(game->moves);
+    utarray_clear(game->undo);
+    pos_from_board(&game->pos, game->board);
+    if (ep_square >= 0) {
+        // only keep it if the pawn that moved two squares is there and can be taken
+        const PieceColor moved = opposite_color(to_move);
+        const int pushed = (moved == WHITE) ? ep_square + 8 : ep_square - 8;
+        if (game->pos.mailbox[pushed] == piece_sprite(PAWN, moved)) {
+            game->ep_square = ep_square_after(&game->pos, pushed, moved);
+        }
+    }
+    game->pos.key = compute_key(game);
+    record_key(game);
+    return true;
+}
+
+void save_fen(const game_t *game, char fen[MAX_FEN_LEN]) {
+    char *c = fen;
+    for (int y=7; y>=0; y--) {
+        int empty = 0;
+        for (int x=0; x<8; x++) {
+            const int sprite = game->board[xy_to_board_idx(x, y)];
+            if (sprite < 0) {
+                empty++;
+                continue;
+            }
+            if (empty > 0) *c++ = '0' + empty;
+            empty = 0;
+            const char p = "kqbnrp"[sprite_type(sprite)];
+            *c++ = (sprite_color(sprite) == WHITE) ? toupper(p) : p;
+        }
+        if (empty > 0) *c++ = '0' + empty;
+        if (y > 0) *c++ = '/';
+    }
+    *c++ = ' ';
+    *c++ = (game->to_move == WHITE) ? 'w' : 'b';
+    *c++ = ' ';
+    if (game->castling == 0) *c++ = '-';
+    for (int i=0; i<4; i++) {
+        if (game->castling & (1 << i)) *c++ = "KQkq"[i];
+    }
+    *c++ = ' ';
+    if (game->ep_square >= 0) {
+        *c++ = files[game->ep_square % 8];
+        *c++ = ranks[game->ep_square / 8];
+    } else {
+        *c++ = '-';
+    }
+    snprintf(c, MAX_FEN_LEN - (c - fen), " %d %d", game->halfmove_clock, game->fullmove_number);
+}
+
+void save_fen_at(game_t *game, int plies_back, char fen[MAX_FEN_LEN]) {
+    const int ply = utarray_len(game->moves);
+    if (plies_back > ply) plies_back = ply;
+    if (plies_back <= 0) {
+        save_fen(game, fen);
+        return;
+    }
+    const move_t *first = (const move_t *)utarray_eltptr(game->moves, (unsigned)(ply - plies_back));
+    if (first == NULL) return;
+    move_t *replay = malloc(plies_back * sizeof(move_t));
+    memcpy(replay, first, plies_back * sizeof(move_t));
+    for (int i=0; i<plies_back; i++) unmake_move(game);
+    save_fen(game, fen);
+    for (int i=0; i<plies_back; i++) make_move(game, replay[i]);
+    free(replay);
+}
+
+void history_move_str(const game_t *game, int plies_back, char str[6]) {
+    const int ply = utarray_len(game->undo);
+    const undo_t *u = (const undo_t *)utarray_eltptr(game->undo, (unsigned)(ply - plies_back));
+    int i = 0;
+    str[i++] = files[u->move.from.x];
+    str[i++] = ranks[u->move.from.y];
+    str[i++] = files[u->move.to.x];
+    str[i++] = ranks[u->move.to.y];
+    if (sprite_type(u->moved) == PAWN && u->move.piece_id != u->moved) {
+        str[i++] = "kqbnrp"[sprite_type(u->move.piece_id)];
+    }
+    str[i] = '\0';
+}
+
 bool is_move_castle(move_t move) {
     if (move.piece_id != KING_W && move.piece_id != KING_B) return false;
     if (move.from.x == 4 && move.from.y == 0 && move.to.x == 6 && move.to.y == 0) return true;
@@ -125,281 +380,308 @@ bool is_move_en_passant(int board[64], move_t move) {
     return true;
 }
 
-void add_move(game_t *game, v2i pos, int x, int y) {
-    int start_idx = v2i_to_board_idx(pos);
-    int end_idx = xy_to_board_idx(x, y);
-    Piece p = piece_at(game->board, pos.x, pos.y);
-    if (!game->skip_check_check && is_moving_into_check(game, p, start_idx, end_idx)) return;
-    game->avail[game->avail_len].x = x;
-    game->avail[game->avail_len].y = y;
-    game->avail_len++;
+
+// everything the legal move filter needs to know about a position, computed once per position
+typedef struct {
+    bool legal;             // false when skip_check_check asks for pseudo-legal moves
+    int king_sq;
+    bitboard_t check_mask;  // squares a non-king move must land on to get out of check
+    bitboard_t pinned;      // pieces that may only move along the line to their king
+} check_info_t;
+
+static void init_check_info(const game_t *game, PieceColor color, check_info_t *ci) {
+    const position_t *pos = &game->pos;
+    const PieceColor enemy = opposite_color(color);
+    ci->king_sq = pos->king_sq[color_idx(color)];
+    ci->legal = !game->skip_check_check && ci->king_sq >= 0;
+    ci->check_mask = ~0ULL;
+    ci->pinned = 0;
+    if (!ci->legal) return;
+    const bitboard_t checkers = attackers_of(pos, ci->king_sq, enemy, pos->occupied);
+    if (bb_count(checkers) > 1) {
+        // only the king can move out of a double check
+        ci->check_mask = 0;
+    } else if (checkers) {
+        // capture the checking piece or block its line
+        ci->check_mask = checkers | between_bb[ci->king_sq][bb_lsb(checkers)];
+    }
+    // a piece is pinned if it's the only thing between the king and an enemy slider
+    const bitboard_t *ep = pos->pieces[color_idx(enemy)];
+    bitboard_t snipers = (rook_attacks(ci->king_sq, 0) & (ep[ROOK] | ep[QUEEN]))
+        | (bishop_attacks(ci->king_sq, 0) & (ep[BISHOP] | ep[QUEEN]));
+    while (snipers) {
+        const bitboard_t blockers = between_bb[ci->king_sq][bb_pop_lsb(&snipers)] & pos->occupied;
+        if (bb_count(blockers) == 1) ci->pinned |= blockers & pos->colors[color_idx(color)];
+    }
 }
 
-void valid_moves(game_t *game, v2i pos) {
-    game->avail_len = 0;
-    Piece p = piece_at(game->board, pos.x, pos.y);
-    if (!game->skip_check_check && p.type != KING && is_king_double_checked(game, find_king_pos(game->board, p.color))) return;
-    switch (p.type) {
+// the en passant capture has to be tested on its own because it clears two squares at once
+static bool is_en_passant_legal(const game_t *game, const check_info_t *ci, int from, int to) {
+    if (!ci->legal) return true;
+    const PieceColor color = sprite_color(game->pos.mailbox[from]);
+    const int captured = xy_to_board_idx(to % 8, from / 8);
+    const bitboard_t occupied = (game->pos.occupied ^ sq_bb(from) ^ sq_bb(captured)) | sq_bb(to);
+    const bitboard_t attackers = attackers_of(&game->pos, ci->king_sq, opposite_color(color), occupied);
+    return (attackers & ~sq_bb(captured)) == 0;
+}
+
+// every legal destination for the piece on sq
+static bitboard_t piece_targets(game_t *game, const check_info_t *ci, int sq) {
+    const position_t *pos = &game->pos;
+    const int sprite = pos->mailbox[sq];
+    const PieceColor color = sprite_color(sprite);
+    if (color == NO_COLOR) return 0;
+    const bitboard_t own = pos->colors[color_idx(color)];
+    const bitboard_t enemies = pos->colors[color_idx(opposite_color(color))];
+    const v2i from = {.x = sq % 8, .y = sq / 8};
+    bitboard_t targets = 0;
+    switch (sprite_type(sprite)) {
         case NO_PIECE: {
-            break;
+            return 0;
         }
-        case ROOK: {
-            rook_moves(game, pos);
-            break;;
+        case KING: {
+            targets = king_attacks[sq] & ~own;
+            if (ci->legal) {
+                // the king can't step onto an attacked square, including ones behind it on a slider's line
+                const bitboard_t occupied = pos->occupied & ~sq_bb(sq);
+                for (bitboard_t b = targets; b; ) {
+                    const int to = bb_pop_lsb(&b);
+                    if (attackers_of(pos, to, opposite_color(color), occupied)) targets &= ~sq_bb(to);
+                }
+            }
+            if (can_king_castle(game, color, true)) {
+                targets |= sq_bb(v2i_to_board_idx(get_castle_move(color, true).to));
+            }
+            if (can_king_castle(game, color, false)) {
+                targets |= sq_bb(v2i_to_board_idx(get_castle_move(color, false).to));
+            }
+            // the king isn't subject to the check mask or pins
+            return targets;
         }
-        case KNIGHT: {
-            knight_moves(game, pos);
+        case QUEEN: {
+            targets = queen_attacks(sq, pos->occupied) & ~own;
             break;
         }
         case BISHOP: {
-            bishop_moves(game, pos);
+            targets = bishop_attacks(sq, pos->occupied) & ~own;
             break;
         }
-        case QUEEN: {
-            queen_moves(game, pos);
+        case KNIGHT: {
+            targets = knight_attacks[sq] & ~own;
             break;
         }
-        case KING: {
-            king_moves(game, pos);
+        case ROOK: {
+            targets = rook_attacks(sq, pos->occupied) & ~own;
             break;
         }
         case PAWN: {
-            pawn_moves(game, pos);
+            const int dy = (color == WHITE) ? 1 : -1;
+            const int st_rank = (color == WHITE) ? 1 : 6;
+            // a pawn can move one space forward into an empty space, or two from its starting position
+            const int one = sq + (8 * dy);
+            if (one >= 0 && one < 64 && !(pos->occupied & sq_bb(one))) {
+                targets |= sq_bb(one);
+                const int two = one + (8 * dy);
+                if (from.y == st_rank && !(pos->occupied & sq_bb(two))) targets |= sq_bb(two);
+            }
+            // a pawn can move one diagonal space ahead to capture
+            targets |= pawn_attacks[color_idx(color)][sq] & enemies;
             break;
         }
     }
-}
-
-void rook_moves(game_t *game, v2i pos) {
-    const PieceColor moving_color = color_at(game->board, pos.x, pos.y);
-    int x = pos.x-1;
-    int y = pos.y;
-    while (x >= 0) {
-        Piece op = piece_at(game->board, x, y);
-        if (op.type == NO_PIECE) {
-            add_move(game, pos, x, y);
-        } else if (op.color != moving_color) {
-            add_move(game, pos, x, y);
-            break;
-        } else {
-            break;
-        }
-        x--;
-    }
-    x = pos.x+1;
-    y = pos.y;
-    while (x < 8) {
-        Piece op = piece_at(game->board, x, y);
-        if (op.type == NO_PIECE) {
-            add_move(game, pos, x, y);
-        } else if (op.color != moving_color) {
-            add_move(game, pos, x, y);
-            break;
-        } else {
-            break;
-        }
-        x++;
-    }
-    x = pos.x;
-    y = pos.y-1;
-    while (y >= 0) {
-        Piece op = piece_at(game->board, x, y);
-        if (op.type == NO_PIECE) {
-            add_move(game, pos, x, y);
-        } else if (op.color != moving_color) {
-            add_move(game, pos, x, y);
-            break;
-        } else {
-            break;
+    if (ci->legal) {
+        targets &= ci->check_mask;
+        if (ci->pinned & sq_bb(sq)) targets &= line_bb[ci->king_sq][sq];
+    }
+    if (sprite_type(sprite) == PAWN) {
+        const int y = from.y + ((color == WHITE) ? 1 : -1);
+        if (can_pawn_move_en_passant(game, from, true) && is_en_passant_legal(game, ci, sq, xy_to_board_idx(from.x - 1, y))) {
+            targets |= sq_bb(xy_to_board_idx(from.x - 1, y));
         }
-        y--;
-    }
-    x = pos.x;
-    y = pos.y+1;
-    while (y < 8) {
-        Piece op = piece_at(game->board, x, y);
-        if (op.type == NO_PIECE) {
-            add_move(game, pos, x, y);
-        } else if (op.color != moving_color) {
-            add_move(game, pos, x, y);
-            break;
-        } else {
-            break;
-        }
-        y++;
-    }
-}
-
-void knight_moves(game_t *game, v2i pos) {
-    const PieceColor moving_color = color_at(game->board, pos.x, pos.y);
-    // all the ways the knight could move
-    v2i km[8] = {
-        {.x = pos.x-1, .y = pos.y+2},
-        {.x = pos.x+1, .y = pos.y+2},
-        {.x = pos.x-1, .y = pos.y-2},
-        {.x = pos.x+1, .y = pos.y-2},
-        {.x = pos.x+2, .y = pos.y+1},
-        {.x = pos.x-2, .y = pos.y+1},
-        {.x = pos.x+2, .y = pos.y-1},
-        {.x = pos.x-2, .y = pos.y-1},
-    };
-    for (int i=0; i<8; i++) {
-        const v2i m = km[i];
-        // don't go off the board
-        if (m.x < 0 || m.x > 7 || m.y < 0 || m.y > 7) continue;
-        Piece op = piece_at(game->board, m.x, m.y);
-        if (op.type == NO_PIECE || op.color != moving_color) {
-            add_move(game, pos, m.x, m.y);
+        if (can_pawn_move_en_passant(game, from, false) && is_en_passant_legal(game, ci, sq, xy_to_board_idx(from.x + 1, y))) {
+            targets |= sq_bb(xy_to_board_idx(from.x + 1, y));
         }
     }
+    return targets;
 }
 
-void bishop_moves(game_t *game, v2i pos) {
-    const PieceColor moving_color = color_at(game->board, pos.x, pos.y);
-    int x = pos.x-1;
-    int y = pos.y-1;
-    while (x >= 0 && y >= 0) {
-        Piece op = piece_at(game->board, x, y);
-        if (op.type == NO_PIECE) {
-            add_move(game, pos, x, y);
-        } else if (op.color != moving_color) {
-            add_move(game, pos, x, y);
-            break;
-        } else {
-            break;
+void valid_moves(game_t *game, v2i pos) {
+    game->avail_len = 0;
+    const int sq = v2i_to_board_idx(pos);
+    const PieceColor color = sprite_color(game->pos.mailbox[sq]);
+    if (color == NO_COLOR) return;
+    check_info_t ci;
+    init_check_info(game, color, &ci);
+    bitboard_t targets = piece_targets(game, &ci, sq);
+    while (targets) {
+        const int to = bb_pop_lsb(&targets);
+        game->avail[game->avail_len].x = to % 8;
+        game->avail[game->avail_len].y = to / 8;
+        game->avail_len++;
+    }
+}
+
+// the MOVE_* flags for moving the piece on 'from' to 'to'; promotion picks the promotion piece
+// and is ignored unless a pawn is moving to the last rank
+static int move_flags(const game_t *game, int from, int to, PieceType promotion) {
+    const int sprite = game->pos.mailbox[from];
+    int flags = (game->pos.occupied & sq_bb(to)) ? MOVE_CAPTURE : MOVE_QUIET;
+    switch (sprite_type(sprite)) {
+        case PAWN: {
+            if (to == game->ep_square && (from % 8) != (to % 8)) return MOVE_EP_CAPTURE;
+            if (abs(to - from) == 16) return MOVE_DOUBLE_PUSH;
+            if (to / 8 == 0 || to / 8 == 7) {
+                const int promo_bits = (promotion == KNIGHT) ? 0 : (promotion == BISHOP) ? 1 : (promotion == ROOK) ? 2 : 3;
+                flags |= MOVE_PROMOTION | promo_bits;
+            }
+            return flags;
         }
-        x--;
-        y--;
-    }
-    x = pos.x+1;
-    y = pos.y+1;
-    while (x < 8 && y < 8) {
-        Piece op = piece_at(game->board, x, y);
-        if (op.type == NO_PIECE) {
-            add_move(game, pos, x, y);
-        } else if (op.color != moving_color) {
-            add_move(game, pos, x, y);
-            break;
-        } else {
-            break;
+        case KING: {
+            if (to - from == 2) return MOVE_CASTLE_SHORT;
+            if (from - to == 2) return MOVE_CASTLE_LONG;
+            return flags;
         }
-        x++;
-        y++;
-    }
-    x = pos.x+1;
-    y = pos.y-1;
-    while (x < 8 && y >= 0) {
-        Piece op = piece_at(game->board, x, y);
-        if (op.type == NO_PIECE) {
-            add_move(game, pos, x, y);
-        } else if (op.color != moving_color) {
-            add_move(game, pos, x, y);
-            break;
-        } else {
-            break;
+        default: {
+            return flags;
         }
-        x++;
-        y--;
-    }
-    x = pos.x-1;
-    y = pos.y+1;
-    while (x >= 0 && y < 8) {
-        Piece op = piece_at(game->board, x, y);
-        if (op.type == NO_PIECE) {
-            add_move(game, pos, x, y);
-        } else if (op.color != moving_color) {
-            add_move(game, pos, x, y);
-            break;
-        } else {
-            break;
+    }
+}
+
+static void generate_moves(game_t *game, PieceColor color, movelist *list) {
+    static const PieceType promotions[4] = { QUEEN, ROOK, BISHOP, KNIGHT };
+    const int promo_rank = (color == WHITE) ? 7 : 0;
+    check_info_t ci;
+    init_check_info(game, color, &ci);
+    list->count = 0;
+    bitboard_t pieces = game->pos.colors[color_idx(color)];
+    // with two checkers only the king has moves
+    if (ci.legal && ci.check_mask == 0) pieces = sq_bb(ci.king_sq);
+    while (pieces) {
+        const int from = bb_pop_lsb(&pieces);
+        const bool is_pawn = sprite_type(game->pos.mailbox[from]) == PAWN;
+        bitboard_t targets = piece_targets(game, &ci, from);
+        while (targets) {
+            const int to = bb_pop_lsb(&targets);
+            if (is_pawn && to / 8 == promo_rank) {
+                for (int i=0; i<4; i++) {
+                    list->moves[list->count++] = make_packed_move(from, to, move_flags(game, from, to, promotions[i]));
+                }
+            } else {
+                list->moves[list->count++] = make_packed_move(from, to, move_flags(game, from, to, NO_PIECE));
+            }
         }
-        x--;
-        y++;
     }
 }
 
-void queen_moves(game_t *game, v2i pos) {
-    rook_moves(game, pos);
-    bishop_moves(game, pos);
+void generate_legal_moves(game_t *game, movelist *list) {
+    generate_moves(game, game->to_move, list);
 }
 
-void king_moves(game_t *game, v2i pos) {
-    const PieceColor moving_color = color_at(game->board, pos.x, pos.y);
-    // all the ways the king could move, except castling
-    v2i km[8] = {
-        {.x = pos.x-1, .y = pos.y+1},
-        {.x = pos.x, .y = pos.y+1},
-        {.x = pos.x+1, .y = pos.y+1},
-        {.x = pos.x-1, .y = pos.y},
-        {.x = pos.x+1, .y = pos.y},
-        {.x = pos.x-1, .y = pos.y-1},
-        {.x = pos.x, .y = pos.y-1},
-        {.x = pos.x+1, .y = pos.y-1},
-    };
-    for (int i=0; i<8; i++) {
-        const v2i m = km[i];
-        // don't go off the board
-        if (m.x < 0 || m.x > 7 || m.y < 0 || m.y > 7) continue;
-        Piece op = piece_at(game->board, m.x, m.y);
-        if (op.type == NO_PIECE || op.color != moving_color) {
-            add_move(game, pos, m.x, m.y);
-        }
-    }
-    if (can_king_castle(game, moving_color, true)) {
-        move_t move = get_castle_move(moving_color, true);
-        add_move(game, move.from, move.to.x, move.to.y);
-    }
-    if (can_king_castle(game, moving_color, false)) {
-        move_t move = get_castle_move(moving_color, false);
-        add_move(game, move.from, move.to.x, move.to.y);
+bool has_legal_move(game_t *game, PieceColor color) {
+    check_info_t ci;
+    init_check_info(game, color, &ci);
+    // the king is the piece most likely to have a move when the position is close to mate
+    const int king_sq = game->pos.king_sq[color_idx(color)];
+    if (king_sq >= 0 && piece_targets(game, &ci, king_sq)) return true;
+    if (ci.legal && ci.check_mask == 0) return false;
+    bitboard_t pieces = game->pos.colors[color_idx(color)] & ~game->pos.pieces[color_idx(color)][KING];
+    while (pieces) {
+        if (piece_targets(game, &ci, bb_pop_lsb(&pieces))) return true;
     }
+    return false;
 }
 
-void pawn_moves(game_t *game, v2i pos) {
-    const PieceColor moving_color = color_at(game->board, pos.x, pos.y);
-    int dy = (moving_color == WHITE) ? 1 : -1;
-    int st_rank = (moving_color == WHITE) ? 1 : 6;
-    // a pawn can move one space forward into an empty space
-    int y = pos.y + dy;
-    if (y >= 0 && y < 8) {
-        Piece op_sa = piece_at(game->board, pos.x, y);
-        if (op_sa.type == NO_PIECE) {
-            add_move(game, pos, pos.x, y);
-        }
+packed_move_t pack_move(const game_t *game, move_t m) {
+    const int from = v2i_to_board_idx(m.from);
+    const int to = v2i_to_board_idx(m.to);
+    return make_packed_move(from, to, move_flags(game, from, to, sprite_type(m.piece_id)));
+}
+
+move_t unpack_move(const game_t *game, packed_move_t m) {
+    const int from = packed_move_from(m);
+    const int to = packed_move_to(m);
+    move_t mv = { .from = {.x = from % 8, .y = from / 8}, .to = {.x = to % 8, .y = to / 8}, .piece_id = game->board[from] };
+    if (is_packed_promotion(m)) mv.piece_id = piece_sprite(packed_promotion_type(m), sprite_color(mv.piece_id));
+    return mv;
+}
+
+void packed_move_to_str(packed_move_t m, char str[6]) {
+    const int from = packed_move_from(m);
+    const int to = packed_move_to(m);
+    int i = 0;
+    str[i++] = files[from % 8];
+    str[i++] = ranks[from / 8];
+    str[i++] = files[to % 8];
+    str[i++] = ranks[to / 8];
+    if (is_packed_promotion(m)) str[i++] = "nbrq"[packed_move_flags(m) & 3];
+    str[i] = '\0';
+}
+
+packed_move_t str_to_packed_move(game_t *game, const char *mstr) {
+    if (strlen(mstr) < 4) return MOVE_NONE;
+    if (mstr[0] < 'a' || mstr[0] > 'h' || mstr[1] < '1' || mstr[1] > '8') return MOVE_NONE;
+    if (mstr[2] < 'a' || mstr[2] > 'h' || mstr[3] < '1' || mstr[3] > '8') return MOVE_NONE;
+    const int from = xy_to_board_idx(mstr[0] - 'a', mstr[1] - '1');
+    const int to = xy_to_board_idx(mstr[2] - 'a', mstr[3] - '1');
+    // in the order of the promotion flag bits; a promotion without a piece letter is a queen
+    static const char *promo_chars = "nbrq";
+    const char *promo = (mstr[4] != '\0' && mstr[4] != ' ') ? strchr(promo_chars, mstr[4]) : NULL;
+    const int promo_bits = (promo != NULL) ? (int)(promo - promo_chars) : 3;
+    movelist list;
+    generate_legal_moves(game, &list);
+    for (int i=0; i<list.count; i++) {
+        const packed_move_t m = list.moves[i];
+        if (packed_move_from(m) != from || packed_move_to(m) != to) continue;
+        if (is_packed_promotion(m) && (packed_move_flags(m) & 3) != promo_bits) continue;
+        return m;
     }
-    // a pawn can move two spaces forward from its starting position
-    if (pos.y == st_rank) {
-        int yy = pos.y + (2 * dy);
-        if (yy >= 0 && yy < 8) {
-            Piece op_sa = piece_at(game->board, pos.x, y);
-            Piece op_da = piece_at(game->board, pos.x, yy);
-            if (op_da.type == NO_PIECE && op_sa.type == NO_PIECE) {
-                add_move(game, pos, pos.x, yy);
+    return MOVE_NONE;
+}
+
+void packed_move_to_san(game_t *game, packed_move_t m, char str[MAX_SAN_LEN]) {
+    const int from = packed_move_from(m);
+    const int to = packed_move_to(m);
+    const int flags = packed_move_flags(m);
+    const PieceType type = sprite_type(game->board[from]);
+    char *c = str;
+    if (flags == MOVE_CASTLE_SHORT || flags == MOVE_CASTLE_LONG) {
+        c += sprintf(c, (flags == MOVE_CASTLE_SHORT) ? "O-O" : "O-O-O");
+    } else {
+        // in PieceType order
+        static const char *piece_chars = "KQBNR";
+        if (type == PAWN) {
+            if (is_packed_capture(m)) *c++ = files[from % 8];
+        } else {
+            *c++ = piece_chars[type];
+            // name the from file, rank or square when another piece of the kind can get there too
+            movelist list;
+            generate_legal_moves(game, &list);
+            bool ambiguous = false, same_file = false, same_rank = false;
+            for (int i=0; i<list.count; i++) {
+                const int other = packed_move_from(list.moves[i]);
+                if (packed_move_to(list.moves[i]) != to || other == from) continue;
+                if (sprite_type(game->board[other]) != type) continue;
+                ambiguous = true;
+                if (other % 8 == from % 8) same_file = true;
+                if (other / 8 == from / 8) same_rank = true;
             }
+            if (ambiguous && (!same_file || same_rank)) *c++ = files[from % 8];
+            if (ambiguous && same_file) *c++ = ranks[from / 8];
         }
-    }
-    // a pawn can move one diagonal space ahead to capture
-    y = pos.y + dy;
-    if (pos.x > 0 && y >= 0 && y < 8) {
-        Piece op_cap1 = piece_at(game->board, pos.x-1, y);
-        if (op_cap1.type != NO_PIECE && op_cap1.color != moving_color) {
-            add_move(game, pos, pos.x-1, y);
+        if (is_packed_capture(m)) *c++ = 'x';
+        *c++ = files[to % 8];
+        *c++ = ranks[to / 8];
+        if (is_packed_promotion(m)) {
+            *c++ = '=';
+            *c++ = piece_chars[packed_promotion_type(m)];
         }
     }
-    if (pos.x < 7 && y >= 0 && y < 8) {
-        Piece op_cap2 = piece_at(game->board, pos.x+1, y);
-        if (op_cap2.type != NO_PIECE && op_cap2.color != moving_color) {
-            add_move(game, pos, pos.x+1, y);
-        }
-    }
-    if (can_pawn_move_en_passant(game, pos, true)) {
-        add_move(game, pos, pos.x-1, y);
-    }
-    if (can_pawn_move_en_passant(game, pos, false)) {
-        add_move(game, pos, pos.x+1, y);
+    make_move(game, unpack_move(game, m));
+    if (is_check(game, find_king_pos(game, game->to_move))) {
+        *c++ = has_legal_move(game, game->to_move) ? '+' : '#';
     }
-    // TODO: indicate to the caller in the case that a promotion would occur
-    // int promo_rank = (moving_color == WHITE) ? 7 : 0;
+    unmake_move(game);
+    *c = '\0';
 }
 
 move_t get_castle_move(PieceColor color_moving, bool shortCastle) {
@@ -432,34 +714,26 @@ move_t get_castle_move(PieceColor color_moving, bool shortCastle) {
 }
 
 bool can_pawn_move_en_passant(game_t *game, v2i pawn_pos, bool negative_x) {
-    Piece pawn = piece_at(game->board, pawn_pos.x, pawn_pos.y);
+    if (game->ep_square < 0) return false;
+    Piece pawn = sprite_to_piece(game->pos.mailbox[v2i_to_board_idx(pawn_pos)]);
     if (pawn.type != PAWN) return false;
-    int allowed_pawn_y = (pawn.color == WHITE) ? 4 : 3;
+    // the en passant square has to be diagonally ahead of the pawn on the side asked about
     int dy = (pawn.color == WHITE) ? 1 : -1;
-    int other_pawn_piece_id = (pawn.color == WHITE) ? PAWN_B : PAWN_W;
-    if (pawn_pos.y != allowed_pawn_y) return false;
-    move_t *last_move = utarray_back(game->moves);
-    // the last move must have been a pawn move
-    if (last_move->piece_id != other_pawn_piece_id) return false;
-    // on the last move the opposing pawn must have landed on the same rank as the pawn that's moving
-    if (last_move->to.y != pawn_pos.y) return false;
-    // on the last move the opposing pawn must have moved two spaces
-    if (last_move->from.y != pawn_pos.y + (2 * dy)) return false;
-    // the last move must have landed beside our pawn
-    int allowed_pawn_x = (negative_x) ? pawn_pos.x - 1 : pawn_pos.x + 1;
-    if (last_move->from.x == allowed_pawn_x) {
-        return true;
-    }
-    return false;
+    int x = (negative_x) ? pawn_pos.x - 1 : pawn_pos.x + 1;
+    if (x < 0 || x > 7 || game->ep_square != xy_to_board_idx(x, pawn_pos.y + dy)) return false;
+    // and the pawn beside it has to belong to the other side, since the square belongs to them
+    return game->pos.mailbox[xy_to_board_idx(x, pawn_pos.y)] == piece_sprite(PAWN, opposite_color(pawn.color));
 }
 
 bool can_king_castle(game_t *game, PieceColor color_moving, bool shortCastle) {
+    // the king and this rook must not have moved, and the rook must not have been captured
+    if (color_moving == NO_COLOR || !(game->castling & castle_right(color_moving, shortCastle))) return false;
     move_t move = get_castle_move(color_moving, shortCastle);
-    // make sure the king is not currently in check
-    if (!game->skip_check_check && is_check(game, move.from)) return false;
     // make sure the king is in the starting position
-    Piece king = piece_at(game->board, move.from.x, move.from.y);
+    Piece king = sprite_to_piece(game->pos.mailbox[v2i_to_board_idx(move.from)]);
     if (king.type != KING || king.color != color_moving) return false;
+    // make sure the king is not currently in check
+    if (!game->skip_check_check && is_check(game, move.from)) return false;
     // make sure all the spaces between the king and the rook are empty
     int start_blank_x = move.from.x + 1;
     int end_blank_x = 7;
@@ -468,18 +742,12 @@ bool can_king_castle(game_t *game, PieceColor color_moving, bool shortCastle) {
         end_blank_x = move.from.x;
     }
     for (int x=start_blank_x; x<end_blank_x; x++) {
-        Piece tp = piece_at(game->board, x, move.from.y);
-        if (tp.type != NO_PIECE) return false;
+        if (game->pos.occupied & sq_bb(xy_to_board_idx(x, move.from.y))) return false;
     }
     // make sure the rook is in the corner
     int rook_x = (move.from.x < move.to.x) ? 7 : 0;
-    Piece rook = piece_at(game->board, rook_x, move.from.y);
+    Piece rook = sprite_to_piece(game->pos.mailbox[xy_to_board_idx(rook_x, move.from.y)]);
     if (rook.type != ROOK || rook.color != color_moving) return false;
-    // make sure the king and rook have not previously moved
-    for (move_t *m=(move_t *)utarray_front(game->moves); m != NULL; m=(move_t *)utarray_next(game->moves, m)) {
-        if (m->from.x == move.from.x && m->from.y == move.from.y) return false;
-        if (m->from.x == rook_x && m->from.y == move.from.y) return false;
-    }
     // hypothetically move the king and make sure it doesn't move through check
     int move_inc = (move.from.x < move.to.x) ? 1 : -1;
     int start_idx = xy_to_board_idx(move.from.x, move.from.y);
@@ -490,61 +758,105 @@ bool can_king_castle(game_t *game, PieceColor color_moving, bool shortCastle) {
     return true;
 }
 
-// you want to use a copied game to call this function
 int check_count(game_t *game, v2i king_pos) {
-    game_t game_copy;
-    copy_game(&game_copy, game, true);
-    // copy the game so we can make the hypothetical move
-    Piece king = piece_at(game_copy.board, king_pos.x, king_pos.y);
-    // collect the possible moves of the other side's pieces and see if any of them land on the king
-    int cnt = 0;
-    for (int i=0; i<64; i++) {
-        v2i pos = {.x = i % 8, .y = i / 8};
-        Piece op = piece_at(game_copy.board, pos.x, pos.y);
-        if (op.type != NO_PIECE && op.color != king.color) {
-            game_copy.avail_len = 0;
-            valid_moves(&game_copy, pos);
-            for (int j=0; j<game_copy.avail_len; j++) {
-                if (game_copy.avail[j].x == king_pos.x && game_copy.avail[j].y == king_pos.y) {
-                    cnt++;
-                }
-            }
-        }
-    }
-    free_game(&game_copy);
-    return cnt;
+    if (king_pos.x < 0 || king_pos.y < 0) return 0;
+    const int king_idx = v2i_to_board_idx(king_pos);
+    const PieceColor king_color = sprite_color(game->pos.mailbox[king_idx]);
+    if (king_color == NO_COLOR) return 0;
+    // see how many of the other side's pieces attack the king
+    return bb_count(attackers_of(&game->pos, king_idx, opposite_color(king_color), game->pos.occupied));
 }
 
 bool is_king_double_checked(game_t *game, v2i king_pos) {
     return (check_count(game, king_pos) > 1);
 }
 
-// you want to use a copied game to call this function
 bool is_check(game_t *game, v2i king_pos) {
-    return (check_count(game, king_pos) > 0);
+    if (king_pos.x < 0 || king_pos.y < 0) return false;
+    const int king_idx = v2i_to_board_idx(king_pos);
+    const PieceColor king_color = sprite_color(game->pos.mailbox[king_idx]);
+    if (king_color == NO_COLOR) return false;
+    return is_square_attacked(&game->pos, king_idx, opposite_color(king_color));
 }
 
 bool is_moving_into_check(game_t *game, Piece piece_moving, int start_idx, int end_idx) {
-    game_t test_game;
-    // copy the game so we can make the hypothetical move
-    copy_game(&test_game, game, true);
-    // make the hypothetical move on the copied board
-    test_game.board[end_idx] = test_game.board[start_idx];
-    test_game.board[start_idx] = -1;
     // find the king of the same color as the piece being moved
-    v2i king_pos = find_king_pos(test_game.board, piece_moving.color);
-    bool ret = is_check(&test_game, king_pos);
-    free_game(&test_game);
-    return ret;
+    const int king_sq = find_king_idx(game, piece_moving.color);
+    if (king_sq < 0) return false;
+    const int king_idx = (piece_moving.type == KING) ? end_idx : king_sq;
+    // look outward from the king with the moving piece lifted off its start square;
+    // a piece captured on the end square can't attack anything
+    const bitboard_t occupied = (game->pos.occupied & ~sq_bb(start_idx)) | sq_bb(end_idx);
+    const bitboard_t attackers = attackers_of(&game->pos, king_idx, opposite_color(piece_moving.color), occupied);
+    return (attackers & ~sq_bb(end_idx)) != 0;
 }
 
 bool is_checkmate(game_t *game, PieceColor color_to_check) {
-    v2i king_pos = find_king_pos(game->board, color_to_check);
-    game_t test_game;
-    // copy the game so we can test moves
-    copy_game(&test_game, game, true);
-    valid_moves(&test_game, king_pos);
-    bool ret = (test_game.avail_len == 0) ? true : false;
-    free_game(&test_game);
-    return ret;
-}
\ No newline at end of file
+    return is_check(game, find_king_pos(game, color_to_check)) && !has_legal_move(game, color_to_check);
+}
+
+void make_move(game_t *game, move_t m) {
+    const int from = v2i_to_board_idx(m.from);
+    const int to = v2i_to_board_idx(m.to);
+    undo_t u = { .move = m, .moved = game->board[from], .captured = game->board[to], .captured_idx = to,
+        .castling = game->castling, .ep_square = game->ep_square, .halfmove_clock = game->halfmove_clock,
+        .key = game->pos.key };
+    const PieceColor color = sprite_color(u.moved);
+    if (game->ep_square >= 0) game->pos.key ^= zobrist_ep[game->ep_square % 8];
+    if (sprite_type(u.moved) == PAWN && to == game->ep_square) {
+        // the captured pawn is beside the start square, not on the end square
+        u.captured_idx = xy_to_board_idx(m.to.x, m.from.y);
+        u.captured = game->board[u.captured_idx];
+        unset_board(game, (v2i){ .x = m.to.x, .y = m.from.y });
+    }
+    if (is_move_castle(m)) {
+        // also move the rook
+        v2i rook_from = { .x = (m.from.x < m.to.x) ? 7 : 0, .y = m.from.y };
+        v2i rook_to = { .x = (m.from.x < m.to.x) ? 5 : 3, .y = m.from.y };
+        set_board(game, rook_to, game->board[v2i_to_board_idx(rook_from)]);
+        unset_board(game, rook_from);
+    }
+    // a pawn reaching the last rank without a promotion piece picked becomes a queen
+    if (sprite_type(u.moved) == PAWN && m.piece_id == u.moved && (m.to.y == 0 || m.to.y == 7)) {
+        u.move.piece_id = piece_sprite(QUEEN, color);
+    }
+    unset_board(game, m.from);
+    set_board(game, m.to, u.move.piece_id);
+    game->pos.key ^= zobrist_castle[game->castling];
+    game->castling &= ~(castle_rights_lost(from) | castle_rights_lost(to));
+    game->pos.key ^= zobrist_castle[game->castling];
+    game->ep_square = is_double_push(u.move) ? ep_square_after(&game->pos, to, color) : -1;
+    if (game->ep_square >= 0) game->pos.key ^= zobrist_ep[game->ep_square % 8];
+    game->pos.key ^= zobrist_side;
+    game->halfmove_clock = (sprite_type(u.moved) == PAWN || u.captured >= 0) ? 0 : game->halfmove_clock + 1;
+    utarray_push_back(game->moves, &u.move);
+    utarray_push_back(game->undo, &u);
+    record_key(game);
+    if (color == BLACK) game->fullmove_number++;
+    game->to_move = opposite_color(color);
+}
+
+void unmake_move(game_t *game) {
+    undo_t *u = (undo_t *)utarray_back(game->undo);
+    if (u == NULL) return;
+    const move_t m = u->move;
+    unset_board(game, m.to);
+    set_board(game, m.from, u->moved);
+    if (u->captured >= 0) {
+        set_board(game, (v2i){ .x = u->captured_idx % 8, .y = u->captured_idx / 8 }, u->captured);
+    }
+    if (is_move_castle(m)) {
+        v2i rook_from = { .x = (m.from.x < m.to.x) ? 7 : 0, .y = m.from.y };
+        v2i rook_to = { .x = (m.from.x < m.to.x) ? 5 : 3, .y = m.from.y };
+        set_board(game, rook_from, game->board[v2i_to_board_idx(rook_to)]);
+        unset_board(game, rook_to);
+    }
+    game->to_move = sprite_color(u->moved);
+    game->castling = u->castling;
+    game->ep_square = u->ep_square;
+    game->halfmove_clock = u->halfmove_clock;
+    if (game->to_move == BLACK) game->fullmove_number--;
+    game->pos.key = u->key;
+    utarray_pop_back(game->moves);
+    utarray_pop_back(game->undo);
+}
@@ -3,20 +3,75 @@
 
 #include "chess_types.h"
 
+#define MAX_MOVES 256
+// longest FEN save_fen writes, with room for the terminator
+#define MAX_FEN_LEN 128
+// longest move packed_move_to_san writes ("exd8=Q+", "Qa1xb2#"), with room for the terminator
+#define MAX_SAN_LEN 8
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+// every legal move in a position, small enough to live on the stack
+typedef struct {
+    packed_move_t moves[MAX_MOVES];
+    int count;
+} movelist;
+
+static inline packed_move_t make_packed_move(int from, int to, int flags) {
+    return (packed_move_t)(from | (to << 6) | (flags << 12));
+}
+
+static inline int packed_move_from(packed_move_t m) {
+    return m & 0x3F;
+}
+
+static inline int packed_move_to(packed_move_t m) {
+    return (m >> 6) & 0x3F;
+}
+
+static inline int packed_move_flags(packed_move_t m) {
+    return m >> 12;
+}
+
+static inline bool is_packed_promotion(packed_move_t m) {
+    return (packed_move_flags(m) & MOVE_PROMOTION) != 0;
+}
+
+static inline bool is_packed_capture(packed_move_t m) {
+    return (packed_move_flags(m) & MOVE_CAPTURE) != 0;
+}
+
+// the piece a promotion turns into, NO_PIECE for any other move
+static inline PieceType packed_promotion_type(packed_move_t m) {
+    static const PieceType types[4] = { KNIGHT, BISHOP, ROOK, QUEEN };
+    return is_packed_promotion(m) ? types[packed_move_flags(m) & 3] : NO_PIECE;
+}
+
 Piece sprite_to_piece(int sprite);
 int v2i_to_board_idx(const v2i v);
 int xy_to_board_idx(const int x, const int y);
 void copy_board(int dst[64], const int src[64]);
+void init_game(game_t *game);
+void reset_game(game_t *game);
 void copy_game(game_t *game_copy, const game_t *game, bool skip_check_check);
 void free_game(game_t *game);
-void set_board(int board[64], v2i pos, int piece_id);
-void unset_board(int board[64], v2i pos);
+uint64_t compute_key(const game_t *game);
+void sync_position(game_t *game);
+void set_board(game_t *game, v2i pos, int piece_id);
+void unset_board(game_t *game, v2i pos);
 Piece piece_at(int board[64], int x, int y);
 PieceColor color_at(int board[64], int x, int y);
 PieceType type_at(int board[64], int x, int y);
-int find_king_idx(int board[64], PieceColor color);
-v2i find_king_pos(int board[64], PieceColor color);
+// the king squares are kept up to date by set_board, so these don't search the board
+int find_king_idx(const game_t *game, PieceColor color);
+v2i find_king_pos(const game_t *game, PieceColor color);
 move_t str_to_move(int board[64], const char *mstr);
+void move_to_str(int board[64], move_t m, char str[6]);
+bool load_fen(game_t *game, const char *fen);
+void save_fen(const game_t *game, char fen[MAX_FEN_LEN]);
+// the FEN of the position plies_back moves ago, found by taking the moves back and replaying them
+void save_fen_at(game_t *game, int plies_back, char fen[MAX_FEN_LEN]);
+// writes the move played plies_back moves ago (1 for the last one) in UCI notation
+void history_move_str(const game_t *game, int plies_back, char str[6]);
 
 bool is_move_castle(move_t move);
 bool is_move_en_passant(int board[64], move_t move);
@@ -29,12 +84,27 @@ move_t get_castle_move(PieceColor color_moving, bool shortCastle);
 bool can_king_castle(game_t *game, PieceColor color_moving, bool shortCastle);
 bool can_pawn_move_en_passant(game_t *game, v2i pawn_pos, bool negative_x);
 
+// plays a move on the board and pushes an undo record for it
+void make_move(game_t *game, move_t m);
+// takes back the last move played with make_move
+void unmake_move(game_t *game);
+
+// fills game->avail with the legal destinations of the piece at pos
 void valid_moves(game_t *game, v2i pos);
-void rook_moves(game_t *game, v2i pos);
-void knight_moves(game_t *game, v2i pos);
-void bishop_moves(game_t *game, v2i pos);
-void queen_moves(game_t *game, v2i pos);
-void king_moves(game_t *game, v2i pos);
-void pawn_moves(game_t *game, v2i pos);
+// fills list with every legal move for the side to move
+void generate_legal_moves(game_t *game, movelist *list);
+// stops at the first legal move it finds for color
+bool has_legal_move(game_t *game, PieceColor color);
+
+// conversions between packed moves, move_t and UCI strings; the game supplies the pieces
+packed_move_t pack_move(const game_t *game, move_t m);
+move_t unpack_move(const game_t *game, packed_move_t m);
+// writes the move in UCI notation into str, which needs room for 6 characters
+void packed_move_to_str(packed_move_t m, char str[6]);
+// the legal move the UCI string names, MOVE_NONE when it isn't one
+packed_move_t str_to_packed_move(game_t *game, const char *mstr);
+// writes a legal move in standard algebraic notation, as used in PGN; the game is in the
+// position before the move and gets put back after the move is tried for check and mate
+void packed_move_to_san(game_t *game, packed_move_t m, char str[MAX_SAN_LEN]);
 
 #endif //MOVES_H
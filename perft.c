@@ -0,0 +1,290 @@
+// cow_perft: counts the leaf nodes of the legal move tree to check the move generator against
+// known results, and reports how fast it goes
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "moves.h"
+#include "bitboard.h"
+#include "util.h"
+#include "threadpool.h"
+#include "hashtable.h"
+
+typedef struct {
+    const char *name;
+    const char *fen;
+    int depth;              // depth the suite runs at unless -d is given
+    uint64_t nodes[8];      // known results, indexed by depth - 1
+} perft_pos;
+
+// https://www.chessprogramming.org/Perft_Results
+static const perft_pos suite[] = {
+    { "startpos", START_FEN, 5,
+        { 20, 400, 8902, 197281, 4865609, 119060324 } },
+    { "kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4,
+        { 48, 2039, 97862, 4085603, 193690690 } },
+    { "position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5,
+        { 14, 191, 2812, 43238, 674624, 11030083, 178633661 } },
+    { "position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4,
+        { 6, 264, 9467, 422333, 15833292 } },
+    { "position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4,
+        { 44, 1486, 62379, 2103487, 89941194 } },
+    { "position 6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4,
+        { 46, 2079, 89890, 3894594, 164075551 } },
+};
+
+// results of earlier subtrees, shared by all the workers; unused when entries is NULL
+static hash_table cache;
+
+// the same position counted to a different depth needs its own entry
+static uint64_t cache_key(const game_t *game, int depth) {
+    return game->pos.key ^ ((uint64_t)depth * 0x9E3779B97F4A7C15ULL);
+}
+
+static uint64_t perft(game_t *game, int depth) {
+    // one ply from the leaves the move count is cheaper than a probe
+    const bool use_cache = cache.entries != NULL && depth >= 2;
+    uint64_t key = 0;
+    if (use_cache) {
+        key = cache_key(game, depth);
+        uint64_t nodes;
+        if (hash_table_probe(&cache, key, &nodes)) return nodes;
+    }
+    movelist list;
+    generate_legal_moves(game, &list);
+    // the moves at the last ply don't need to be played to be counted
+    if (depth <= 1) return (depth == 1) ? (uint64_t)list.count : 1;
+    uint64_t nodes = 0;
+    for (int i=0; i<list.count; i++) {
+        make_move(game, unpack_move(game, list.moves[i]));
+        nodes += perft(game, depth - 1);
+        unmake_move(game);
+    }
+    if (use_cache) hash_table_store(&cache, key, nodes);
+    return nodes;
+}
+
+// A parallel run splits the root into one task per move. A task that is still deep enough splits
+// again whenever a worker is out of work, so the tail of the run stays spread across the pool.
+// Tasks carry the moves that lead to them from the root rather than a position, and each worker
+// replays them on its own copy of the root game.
+
+// deepest a task can sit below the root; anything deeper is counted in one go
+#define MAX_SPLIT_PLY 16
+// smaller subtrees cost less to count than to hand to another thread
+#define MIN_SPLIT_DEPTH 3
+
+typedef struct {
+    packed_move_t path[MAX_SPLIT_PLY];
+    int ply;
+    int depth;
+} perft_task;
+
+// each worker counts into its own line so they don't fight over the cache
+typedef struct {
+    uint64_t nodes;
+    char pad[56];
+} worker_nodes;
+
+static struct {
+    threadpool *pool;       // NULL when running single-threaded
+    game_t *games;          // one copy of the root game per worker
+    int root_ply;           // length of the root game's undo stack
+    worker_nodes *nodes;
+} job;
+
+static void run_perft_task(void *arg, int worker);
+
+static void perft_split(game_t *game, perft_task *t, int worker) {
+    if (t->depth < MIN_SPLIT_DEPTH || t->ply >= MAX_SPLIT_PLY) {
+        job.nodes[worker].nodes += perft(game, t->depth);
+        return;
+    }
+    movelist list;
+    generate_legal_moves(game, &list);
+    for (int i=0; i<list.count; i++) {
+        if (pool_has_idle(job.pool)) {
+            perft_task *child = malloc(sizeof(perft_task));
+            memcpy(child->path, t->path, t->ply * sizeof(packed_move_t));
+            child->path[t->ply] = list.moves[i];
+            child->ply = t->ply + 1;
+            child->depth = t->depth - 1;
+            pool_submit(job.pool, run_perft_task, child);
+            continue;
+        }
+        t->path[t->ply++] = list.moves[i];
+        t->depth--;
+        make_move(game, unpack_move(game, list.moves[i]));
+        perft_split(game, t, worker);
+        unmake_move(game);
+        t->depth++;
+        t->ply--;
+    }
+}
+
+static void run_perft_task(void *arg, int worker) {
+    perft_task *t = arg;
+    game_t *game = &job.games[worker];
+    while ((int)utarray_len(game->undo) > job.root_ply) {
+        unmake_move(game);
+    }
+    for (int i=0; i<t->ply; i++) {
+        make_move(game, unpack_move(game, t->path[i]));
+    }
+    perft_split(game, t, worker);
+    free(t);
+}
+
+static uint64_t parallel_perft(game_t *root, int depth) {
+    if (depth < MIN_SPLIT_DEPTH) return perft(root, depth);
+    const int thread_count = pool_thread_count(job.pool);
+    job.root_ply = (int)utarray_len(root->undo);
+    job.games = malloc(thread_count * sizeof(game_t));
+    job.nodes = calloc(thread_count, sizeof(worker_nodes));
+    for (int i=0; i<thread_count; i++) {
+        copy_game(&job.games[i], root, false);
+    }
+
+    movelist list;
+    generate_legal_moves(root, &list);
+    for (int i=0; i<list.count; i++) {
+        perft_task *t = malloc(sizeof(perft_task));
+        t->path[0] = list.moves[i];
+        t->ply = 1;
+        t->depth = depth - 1;
+        pool_submit(job.pool, run_perft_task, t);
+    }
+    pool_wait(job.pool);
+
+    uint64_t nodes = 0;
+    for (int i=0; i<thread_count; i++) {
+        nodes += job.nodes[i].nodes;
+        free_game(&job.games[i]);
+    }
+    free(job.games);
+    free(job.nodes);
+    return nodes;
+}
+
+static uint64_t count_nodes(game_t *game, int depth) {
+    return (job.pool != NULL) ? parallel_perft(game, depth) : perft(game, depth);
+}
+
+static uint64_t divide(game_t *game, int depth) {
+    movelist list;
+    generate_legal_moves(game, &list);
+    uint64_t total = 0;
+    for (int i=0; i<list.count; i++) {
+        char mstr[6];
+        packed_move_to_str(list.moves[i], mstr);
+        make_move(game, unpack_move(game, list.moves[i]));
+        const uint64_t nodes = count_nodes(game, depth - 1);
+        unmake_move(game);
+        printf("%s: %" PRIu64 "\n", mstr, nodes);
+        total += nodes;
+    }
+    return total;
+}
+
+static void print_rate(uint64_t nodes, int64_t ms) {
+    const double nps = (ms > 0) ? (double)nodes * 1000.0 / (double)ms : 0.0;
+    printf("%" PRIu64 " nodes in %" PRId64 " ms (%.0f nodes/s)\n", nodes, ms, nps);
+}
+
+static int run_suite(game_t *game, int depth) {
+    int failures = 0;
+    uint64_t total_nodes = 0;
+    int64_t total_ms = 0;
+    for (size_t i=0; i<sizeof(suite) / sizeof(suite[0]); i++) {
+        const perft_pos *p = &suite[i];
+        const int d = (depth > 0) ? depth : p->depth;
+        if (d > 8 || p->nodes[d - 1] == 0) {
+            printf("%-12s depth %d: no known result, skipping\n", p->name, d);
+            continue;
+        }
+        load_fen(game, p->fen);
+        // start each position cold so the times are comparable from run to run
+        if (cache.entries != NULL) hash_table_clear(&cache);
+        const int64_t start = system_msec();
+        const uint64_t nodes = count_nodes(game, d);
+        const int64_t ms = system_msec() - start;
+        const bool ok = (nodes == p->nodes[d - 1]);
+        if (!ok) failures++;
+        printf("%-12s depth %d: %s ", p->name, d, ok ? "ok  " : "FAIL");
+        if (!ok) printf("(expected %" PRIu64 ") ", p->nodes[d - 1]);
+        print_rate(nodes, ms);
+        total_nodes += nodes;
+        total_ms += ms;
+    }
+    printf("total: ");
+    print_rate(total_nodes, total_ms);
+    return failures;
+}
+
+static void usage(const char *exe) {
+    fprintf(stderr, "usage: %s [-d depth] [-fen \"<fen>\"] [-divide] [-threads n] [-hash mb]\n", exe);
+    fprintf(stderr, "  with no -fen, runs the reference suite and exits non-zero on a mismatch\n");
+    fprintf(stderr, "  -threads defaults to one per cpu; -threads 1 counts on the main thread\n");
+    fprintf(stderr, "  -hash caches subtree counts in a table of that many megabytes (default: off)\n");
+}
+
+int main(int argc, char *argv[]) {
+    int depth = 0;
+    const char *fen = NULL;
+    bool do_divide = false;
+    int thread_count = 0;
+    int hash_mb = 0;
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-fen") == 0 && i + 1 < argc) {
+            fen = argv[++i];
+        } else if (strcmp(argv[i], "-divide") == 0) {
+            do_divide = true;
+        } else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-hash") == 0 && i + 1 < argc) {
+            hash_mb = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    init_bitboards();
+    game_t game;
+    init_game(&game);
+    if (fen != NULL && !load_fen(&game, fen)) {
+        fprintf(stderr, "invalid fen: %s\n", fen);
+        free_game(&game);
+        return EXIT_FAILURE;
+    }
+    if (thread_count <= 0) thread_count = system_cpu_count();
+    if (thread_count > 1) {
+        job.pool = pool_create(thread_count);
+    }
+    printf("threads: %d\n", thread_count);
+    if (hash_mb > 0) {
+        if (!hash_table_init(&cache, (size_t)hash_mb)) {
+            DIE("failed to allocate a %d MB hash table\n", hash_mb);
+        }
+        printf("hash: %zu MB\n", hash_table_size_bytes(&cache) >> 20);
+    }
+
+    int ret = EXIT_SUCCESS;
+    if (fen == NULL && !do_divide) {
+        ret = (run_suite(&game, depth) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else {
+        if (depth < 1) depth = 1;
+        const int64_t start = system_msec();
+        const uint64_t nodes = do_divide ? divide(&game, depth) : count_nodes(&game, depth);
+        const int64_t ms = system_msec() - start;
+        printf("depth %d: ", depth);
+        print_rate(nodes, ms);
+    }
+    if (job.pool != NULL) pool_destroy(job.pool);
+    hash_table_free(&cache);
+    free_game(&game);
+    return ret;
+}
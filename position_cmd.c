@@ -0,0 +1,75 @@
+#include "position_cmd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "moves.h"
+
+void position_cmd_init(position_cmd *pc) {
+    memset(pc, 0, sizeof(*pc));
+}
+
+void position_cmd_free(position_cmd *pc) {
+    free(pc->buf);
+    pc->buf = NULL;
+}
+
+// room for 'extra' more characters plus the newline and terminator
+static void reserve(position_cmd *pc, size_t extra) {
+    const size_t need = pc->len + extra + 2;
+    if (need <= pc->cap) return;
+    size_t cap = (pc->cap > 0) ? pc->cap : 256;
+    while (cap < need) cap *= 2;
+    pc->buf = realloc(pc->buf, cap);
+    pc->cap = cap;
+}
+
+// appends the move that reached game ply 'ply'
+static void append_move(position_cmd *pc, const game_t *game, int ply) {
+    reserve(pc, 12);
+    if (pc->plies == 0) pc->len += sprintf(pc->buf + pc->len, " moves");
+    char mstr[6];
+    history_move_str(game, (int)utarray_len(game->undo) - ply + 1, mstr);
+    pc->len += sprintf(pc->buf + pc->len, " %s", mstr);
+    pc->keys[++pc->plies] = game->key_ring[ply % KEY_RING_SIZE];
+}
+
+// starts over from the last capture or pawn move, which still lets the engine see every
+// position that could repeat
+static void rebuild(position_cmd *pc, game_t *game) {
+    const int ply = utarray_len(game->undo);
+    int since = (game->halfmove_clock < ply) ? game->halfmove_clock : ply;
+    if (since > POSITION_CMD_MAX_PLIES) since = POSITION_CMD_MAX_PLIES;
+    char fen[MAX_FEN_LEN];
+    save_fen_at(game, since, fen);
+    pc->len = 0;
+    reserve(pc, MAX_FEN_LEN + 16);
+    if (strcmp(fen, START_FEN) == 0) {
+        pc->len += sprintf(pc->buf, "position startpos");
+    } else {
+        pc->len += sprintf(pc->buf, "position fen %s", fen);
+    }
+    pc->base_ply = ply - since;
+    pc->plies = 0;
+    pc->keys[0] = game->key_ring[pc->base_ply % KEY_RING_SIZE];
+}
+
+// true when the game went through every position the command lists, in order
+static bool follows_game(const position_cmd *pc, const game_t *game) {
+    const int ply = utarray_len(game->undo);
+    if (pc->len == 0 || pc->base_ply + pc->plies > ply) return false;
+    // past this the ring has been overwritten and there's nothing to check against
+    if (ply - pc->base_ply > POSITION_CMD_MAX_PLIES) return false;
+    for (int i=0; i<=pc->plies; i++) {
+        if (game->key_ring[(pc->base_ply + i) % KEY_RING_SIZE] != pc->keys[i]) return false;
+    }
+    return true;
+}
+
+const char *position_cmd_update(position_cmd *pc, game_t *game) {
+    if (!follows_game(pc, game)) rebuild(pc, game);
+    const int ply = utarray_len(game->undo);
+    for (int p=pc->base_ply + pc->plies + 1; p<=ply; p++) append_move(pc, game, p);
+    pc->buf[pc->len] = '\n';
+    pc->buf[pc->len + 1] = '\0';
+    return pc->buf;
+}
@@ -0,0 +1,31 @@
+#ifndef POSITION_CMD_H
+#define POSITION_CMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chess_types.h"
+
+// The UCI "position" command for a game, kept between engine turns. Each update only appends
+// the moves played since the last one, and the buffer only grows, so sending the position every
+// ply doesn't mean rebuilding (or reallocating) the whole move list each time.
+
+// once the move list is this long the command starts over from the FEN after the last capture or
+// pawn move; it has to stay under KEY_RING_SIZE so the whole list can be checked against the game
+#define POSITION_CMD_MAX_PLIES 100
+
+typedef struct {
+    char *buf;
+    size_t len;         // not counting the newline that always ends the command
+    size_t cap;
+    int base_ply;       // the game ply the command starts from
+    int plies;          // moves listed after it
+    uint64_t keys[POSITION_CMD_MAX_PLIES + 1];  // position key at the base and after each move
+} position_cmd;
+
+void position_cmd_init(position_cmd *pc);
+void position_cmd_free(position_cmd *pc);
+// brings the command up to the game's current position and returns it, newline and all. When
+// the game no longer follows the moves already listed (a takeback, a new game) it starts over.
+const char *position_cmd_update(position_cmd *pc, game_t *game);
+
+#endif //POSITION_CMD_H
@@ -0,0 +1,77 @@
+#include "sprt.h"
+#include <math.h>
+
+// the expected score for an elo difference
+static double elo_to_score(double elo) {
+    return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+}
+
+static double score_to_elo(double score) {
+    return -400.0 * log10(1.0 / score - 1.0);
+}
+
+// the mean score per sample and its variance, where a sample is a game or, for the pentanomial,
+// a game pair scored 0 to 1 like a game; false with fewer than two samples
+static bool score_stats(const match_stats *stats, bool pentanomial, double *mean, double *var, int *n) {
+    if (pentanomial) {
+        static const double pair_score[5] = { 0.0, 0.25, 0.5, 0.75, 1.0 };
+        *n = 0;
+        double sum = 0;
+        for (int i=0; i<5; i++) {
+            *n += stats->penta[i];
+            sum += stats->penta[i] * pair_score[i];
+        }
+        if (*n < 2) return false;
+        *mean = sum / *n;
+        *var = 0;
+        for (int i=0; i<5; i++) {
+            const double d = pair_score[i] - *mean;
+            *var += stats->penta[i] * d * d;
+        }
+        *var /= *n;
+        return true;
+    }
+    *n = stats->wins + stats->losses + stats->draws;
+    if (*n < 2) return false;
+    *mean = (stats->wins + 0.5 * stats->draws) / *n;
+    const double dw = 1.0 - *mean, dd = 0.5 - *mean, dl = -*mean;
+    *var = (stats->wins * dw * dw + stats->draws * dd * dd + stats->losses * dl * dl) / *n;
+    return true;
+}
+
+bool estimate_elo(const match_stats *stats, bool pentanomial, elo_estimate *est) {
+    double mean, var;
+    int n;
+    if (!score_stats(stats, pentanomial, &mean, &var, &n)) return false;
+    // a clean sweep either way has no finite elo
+    if (mean <= 0.0 || mean >= 1.0) return false;
+    const double sd = sqrt(var / n);
+    const double lo = fmax(mean - 1.959964 * sd, 1e-6), hi = fmin(mean + 1.959964 * sd, 1.0 - 1e-6);
+    est->elo = score_to_elo(mean);
+    est->error = (score_to_elo(hi) - score_to_elo(lo)) / 2.0;
+    est->los = (sd > 0) ? 0.5 * (1.0 + erf((mean - 0.5) / (sd * sqrt(2.0)))) : 0.5;
+    return true;
+}
+
+double sprt_llr(const match_stats *stats, bool pentanomial, const sprt_config *cfg) {
+    double mean, var;
+    int n;
+    if (!score_stats(stats, pentanomial, &mean, &var, &n) || var <= 0) return 0.0;
+    // the normal approximation to the generalized SPRT: with the variance taken from the data,
+    // the log likelihood ratio of the two expected scores comes down to this
+    const double s0 = elo_to_score(cfg->elo0), s1 = elo_to_score(cfg->elo1);
+    return n * (s1 - s0) * (2.0 * mean - s0 - s1) / (2.0 * var);
+}
+
+void sprt_bounds(const sprt_config *cfg, double *lower, double *upper) {
+    *lower = log(cfg->beta / (1.0 - cfg->alpha));
+    *upper = log((1.0 - cfg->beta) / cfg->alpha);
+}
+
+sprt_result sprt_test(double llr, const sprt_config *cfg) {
+    double lower, upper;
+    sprt_bounds(cfg, &lower, &upper);
+    if (llr >= upper) return SPRT_ACCEPT_H1;
+    if (llr <= lower) return SPRT_ACCEPT_H0;
+    return SPRT_CONTINUE;
+}
@@ -0,0 +1,42 @@
+#ifndef SPRT_H
+#define SPRT_H
+
+#include <stdbool.h>
+
+// Elo estimates and a sequential probability ratio test over engine match results, so a match
+// can stop as soon as it's clear whether a change gains at least elo1 or no more than elo0.
+// With paired openings (each played twice with the colors swapped) the pairs are scored as a
+// pentanomial: the two games share an opening, so their results aren't independent, and
+// treating them as one sample gives honest (and usually tighter) error bars.
+
+// results for one engine against another
+typedef struct {
+    int wins, losses, draws;
+    int penta[5];       // finished game pairs by the engine's points from both: 0, 0.5, 1, 1.5, 2
+} match_stats;
+
+typedef struct {
+    double elo;
+    double error;       // half the width of the 95% confidence interval
+    double los;         // likelihood of superiority, 0 to 1
+} elo_estimate;
+
+typedef struct {
+    double elo0, elo1;  // the hypotheses: gains no more than elo0 (H0), at least elo1 (H1)
+    double alpha, beta; // false positive and false negative rates
+} sprt_config;
+
+typedef enum {
+    SPRT_CONTINUE,
+    SPRT_ACCEPT_H0,
+    SPRT_ACCEPT_H1,
+} sprt_result;
+
+// false until there are enough results to say anything
+bool estimate_elo(const match_stats *stats, bool pentanomial, elo_estimate *est);
+// the log likelihood ratio of H1 against H0
+double sprt_llr(const match_stats *stats, bool pentanomial, const sprt_config *cfg);
+void sprt_bounds(const sprt_config *cfg, double *lower, double *upper);
+sprt_result sprt_test(double llr, const sprt_config *cfg);
+
+#endif //SPRT_H
@@ -0,0 +1,57 @@
+#include "termination.h"
+#include "moves.h"
+#include "bitboard.h"
+
+#define LIGHT_SQUARES_BB 0x55AA55AA55AA55AAULL
+
+Termination game_termination(game_t *game) {
+    if (!has_legal_move(game, game->to_move)) {
+        return is_check(game, find_king_pos(game, game->to_move)) ? TERM_CHECKMATE : TERM_STALEMATE;
+    }
+    if (is_insufficient_material(game)) return TERM_INSUFFICIENT_MATERIAL;
+    if (is_fifty_move_draw(game)) return TERM_FIFTY_MOVES;
+    if (is_repetition(game, 3)) return TERM_REPETITION;
+    return TERM_NONE;
+}
+
+const char *termination_str(Termination t) {
+    switch (t) {
+        case TERM_NONE: return "in progress";
+        case TERM_CHECKMATE: return "checkmate";
+        case TERM_STALEMATE: return "stalemate";
+        case TERM_REPETITION: return "threefold repetition";
+        case TERM_FIFTY_MOVES: return "fifty move rule";
+        case TERM_INSUFFICIENT_MATERIAL: return "insufficient material";
+    }
+    return "unknown";
+}
+
+bool is_repetition(const game_t *game, int times) {
+    const int ply = utarray_len(game->undo);
+    // only positions with the same side to move can match, and nothing from before the last
+    // irreversible move (or before the ring starts overwriting itself) can
+    int reach = game->halfmove_clock;
+    if (reach > ply) reach = ply;
+    if (reach > KEY_RING_SIZE - 1) reach = KEY_RING_SIZE - 1;
+    int seen = 1;
+    for (int back=4; back<=reach; back+=2) {
+        if (game->key_ring[(ply - back) % KEY_RING_SIZE] == game->pos.key && ++seen >= times) return true;
+    }
+    return false;
+}
+
+bool is_fifty_move_draw(const game_t *game) {
+    return game->halfmove_clock >= 100;
+}
+
+bool is_insufficient_material(const game_t *game) {
+    const position_t *pos = &game->pos;
+    for (int ci=0; ci<2; ci++) {
+        if (pos->pieces[ci][PAWN] | pos->pieces[ci][ROOK] | pos->pieces[ci][QUEEN]) return false;
+    }
+    const bitboard_t knights = pos->pieces[0][KNIGHT] | pos->pieces[1][KNIGHT];
+    const bitboard_t bishops = pos->pieces[0][BISHOP] | pos->pieces[1][BISHOP];
+    if (bb_count(knights | bishops) <= 1) return true;
+    // any number of bishops can't mate if they all move on the same color
+    return !knights && (!(bishops & LIGHT_SQUARES_BB) || !(bishops & ~LIGHT_SQUARES_BB));
+}
@@ -0,0 +1,27 @@
+#ifndef TERMINATION_H
+#define TERMINATION_H
+
+#include "chess_types.h"
+
+typedef enum {
+    TERM_NONE,
+    TERM_CHECKMATE,
+    TERM_STALEMATE,
+    TERM_REPETITION,
+    TERM_FIFTY_MOVES,
+    TERM_INSUFFICIENT_MATERIAL,
+} Termination;
+
+// why the game is over for the side to move, TERM_NONE if it isn't
+Termination game_termination(game_t *game);
+const char *termination_str(Termination t);
+
+// true when the position has come up 'times' times, counting this one, since the last
+// capture or pawn move
+bool is_repetition(const game_t *game, int times);
+bool is_fifty_move_draw(const game_t *game);
+// neither side has the material to mate: kings with at most one minor piece between them, or
+// kings and bishops that all stand on the same color of square
+bool is_insufficient_material(const game_t *game);
+
+#endif //TERMINATION_H
@@ -0,0 +1,220 @@
+#include "threadpool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "util.h"
+
+typedef struct {
+    task_fn fn;
+    void *arg;
+} task_t;
+
+// ring buffer of tasks; the owner pushes and pops at the back, thieves take from the front
+typedef struct {
+    pthread_mutex_t lock;
+    task_t *tasks;
+    int head;
+    int count;
+    int cap;
+} task_deque;
+
+typedef struct {
+    threadpool *pool;
+    int idx;
+    pthread_t thread;
+} worker_t;
+
+struct threadpool {
+    int thread_count;
+    worker_t *workers;
+    task_deque *deques;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   // signalled when a task is queued or the pool is shutting down
+    pthread_cond_t done_cond;   // signalled when the last pending task finishes
+    atomic_int queued;          // tasks sitting in deques (counted before they are pushed)
+    atomic_int pending;         // tasks submitted and not yet finished
+    atomic_int idle;            // workers waiting on work_cond
+    atomic_uint next_deque;     // where the next task submitted from outside the pool goes
+    bool quit;
+};
+
+// which pool and worker the current thread belongs to, so submit can use the worker's own deque
+static _Thread_local threadpool *cur_pool = NULL;
+static _Thread_local int cur_worker = -1;
+
+int system_cpu_count(void) {
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (int)n : 1;
+}
+
+static void deque_init(task_deque *dq) {
+    pthread_mutex_init(&dq->lock, NULL);
+    dq->cap = 64;
+    dq->tasks = malloc(dq->cap * sizeof(task_t));
+    dq->head = 0;
+    dq->count = 0;
+}
+
+static void deque_free(task_deque *dq) {
+    pthread_mutex_destroy(&dq->lock);
+    free(dq->tasks);
+}
+
+static void deque_push_back(task_deque *dq, task_t t) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == dq->cap) {
+        // unroll the ring into a buffer twice the size
+        task_t *tasks = malloc(2 * dq->cap * sizeof(task_t));
+        for (int i=0; i<dq->count; i++) {
+            tasks[i] = dq->tasks[(dq->head + i) % dq->cap];
+        }
+        free(dq->tasks);
+        dq->tasks = tasks;
+        dq->head = 0;
+        dq->cap *= 2;
+    }
+    dq->tasks[(dq->head + dq->count) % dq->cap] = t;
+    dq->count++;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+static bool deque_pop_back(task_deque *dq, task_t *t) {
+    bool found = false;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count > 0) {
+        dq->count--;
+        *t = dq->tasks[(dq->head + dq->count) % dq->cap];
+        found = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static bool deque_pop_front(task_deque *dq, task_t *t) {
+    bool found = false;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count > 0) {
+        *t = dq->tasks[dq->head];
+        dq->head = (dq->head + 1) % dq->cap;
+        dq->count--;
+        found = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static bool find_task(threadpool *pool, int idx, task_t *t) {
+    if (deque_pop_back(&pool->deques[idx], t)) return true;
+    // the oldest task on another deque is the one most likely to be a big subtree
+    for (int i=1; i<pool->thread_count; i++) {
+        if (deque_pop_front(&pool->deques[(idx + i) % pool->thread_count], t)) return true;
+    }
+    return false;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    threadpool *pool = w->pool;
+    cur_pool = pool;
+    cur_worker = w->idx;
+    for (;;) {
+        task_t t;
+        if (find_task(pool, w->idx, &t)) {
+            atomic_fetch_sub(&pool->queued, 1);
+            t.fn(t.arg, w->idx);
+            if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+                pthread_mutex_lock(&pool->lock);
+                pthread_cond_broadcast(&pool->done_cond);
+                pthread_mutex_unlock(&pool->lock);
+            }
+            continue;
+        }
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->idle, 1);
+        while (!pool->quit && atomic_load(&pool->queued) == 0) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        atomic_fetch_sub(&pool->idle, 1);
+        const bool quit = pool->quit && atomic_load(&pool->queued) == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (quit) break;
+    }
+    return NULL;
+}
+
+threadpool *pool_create(int thread_count) {
+    if (thread_count <= 0) thread_count = system_cpu_count();
+    threadpool *pool = calloc(1, sizeof(threadpool));
+    pool->thread_count = thread_count;
+    pool->workers = calloc(thread_count, sizeof(worker_t));
+    pool->deques = calloc(thread_count, sizeof(task_deque));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    atomic_init(&pool->queued, 0);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->idle, 0);
+    atomic_init(&pool->next_deque, 0);
+    for (int i=0; i<thread_count; i++) {
+        deque_init(&pool->deques[i]);
+    }
+    for (int i=0; i<thread_count; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].idx = i;
+        if (pthread_create(&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]) != 0) {
+            DIE("failed to start thread pool worker %d\n", i);
+        }
+    }
+    return pool;
+}
+
+void pool_destroy(threadpool *pool) {
+    pool_wait(pool);
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i=0; i<pool->thread_count; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    // only once every worker is gone, since any of them may still be looking at any deque
+    for (int i=0; i<pool->thread_count; i++) {
+        deque_free(&pool->deques[i]);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->workers);
+    free(pool->deques);
+    free(pool);
+}
+
+int pool_thread_count(const threadpool *pool) {
+    return pool->thread_count;
+}
+
+void pool_submit(threadpool *pool, task_fn fn, void *arg) {
+    const int idx = (cur_pool == pool) ? cur_worker
+        : (int)(atomic_fetch_add(&pool->next_deque, 1) % pool->thread_count);
+    // count the task before it is visible, so a worker can't see it finish before it was counted
+    atomic_fetch_add(&pool->pending, 1);
+    atomic_fetch_add(&pool->queued, 1);
+    deque_push_back(&pool->deques[idx], (task_t){ fn, arg });
+    // taking the lock means a worker that just found queued == 0 is already waiting to be woken
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_wait(threadpool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->pending) > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+bool pool_has_idle(const threadpool *pool) {
+    return atomic_load(&((threadpool *)pool)->idle) > 0;
+}
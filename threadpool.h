@@ -0,0 +1,30 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdbool.h>
+
+// A fixed set of worker threads, each with its own task deque. A worker runs the newest task on
+// its own deque first and, when that runs dry, steals the oldest task from another worker, so
+// big jobs that split themselves up spread across the pool without a central queue.
+
+// worker is the index (0..thread_count-1) of the thread running the task
+typedef void (*task_fn)(void *arg, int worker);
+
+typedef struct threadpool threadpool;
+
+// thread_count <= 0 means one thread per online cpu
+threadpool *pool_create(int thread_count);
+// waits for the queued tasks to finish, then stops the workers
+void pool_destroy(threadpool *pool);
+
+int pool_thread_count(const threadpool *pool);
+// called from a worker the task goes on that worker's deque, otherwise the deques take turns
+void pool_submit(threadpool *pool, task_fn fn, void *arg);
+// blocks until every submitted task (including ones submitted by tasks) has finished
+void pool_wait(threadpool *pool);
+// true when some worker is out of work; tasks use this to decide whether splitting is worth it
+bool pool_has_idle(const threadpool *pool);
+
+int system_cpu_count(void);
+
+#endif //THREADPOOL_H
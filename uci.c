@@ -1,61 +1,175 @@
 // The method used here comes from https://github.com/lucasart/c-chess-cli
 
+#define _GNU_SOURCE // for pipe2 and posix_spawn_file_actions_addchdir_np
 #include "uci.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-void report_error(const int err, const char *msg) {
-    if (err < 0) {
-        fprintf(stderr, "-=-= error: %d - %s\n", err, msg);
+// posix_spawn can only change directory through this extension, which glibc has had since 2.29
+#if defined(__APPLE__) || (defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29)))
+#define HAVE_SPAWN_CHDIR
+#endif
+
+extern char **environ;
+
+// close-on-exec, so an engine doesn't inherit the pipes of the engines started before it; the
+// copies the spawn makes for its stdin and stdout don't have the flag
+static bool make_pipe(int fds[2]) {
+#ifdef __linux__
+    if (pipe2(fds, O_CLOEXEC) < 0) return false;
+#else
+    // not atomic, so a fork on another thread could still catch the pipe open
+    if (pipe(fds) < 0) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+    return true;
+}
+
+// true when the environment entry sets the same variable as the "NAME=value" setting
+static bool same_variable(const char *entry, const char *setting) {
+    const size_t len = strcspn(setting, "=");
+    return strncmp(entry, setting, len) == 0 && entry[len] == '=';
+}
+
+// our environment with the launch's settings replacing or added to it; only the array is new
+static char **engine_environment(const engine_launch *launch) {
+    size_t count = 0;
+    while (environ[count] != NULL) count++;
+    char **envp = malloc((count + launch->env_count + 1) * sizeof(char *));
+    size_t len = 0;
+    for (size_t i=0; i<count; i++) {
+        bool replaced = false;
+        for (int j=0; j<launch->env_count && !replaced; j++) replaced = same_variable(environ[i], launch->env[j]);
+        if (!replaced) envp[len++] = environ[i];
     }
+    for (int j=0; j<launch->env_count; j++) {
+        // when a variable is set twice the later setting wins
+        bool overridden = false;
+        for (int k=j + 1; k<launch->env_count && !overridden; k++) overridden = same_variable(launch->env[j], launch->env[k]);
+        if (!overridden) envp[len++] = (char *)launch->env[j];
+    }
+    envp[len] = NULL;
+    return envp;
 }
 
-void fork_uci_client(const char *client_exe, uci_client *cli) {
+bool spawn_uci_client(const engine_launch *launch, uci_client *cli) {
+    // writing to an engine that has died would kill us with SIGPIPE; the reader sees it close
+    // its end instead
+    signal(SIGPIPE, SIG_IGN);
+#ifndef HAVE_SPAWN_CHDIR
+    if (launch->cwd != NULL) {
+        fprintf(stderr, "-=-= can't start %s in %s: not supported on this system\n", launch->exe, launch->cwd);
+        return false;
+    }
+#endif
     // we'll read from from_uci[0] and write to to_uci[1]
     // the uci client will read from to_uci[0] and write to from_uci[1]
-    int to_uci[2] = { 0 };
-    int from_uci[2] = { 0 };
-    int err = pipe(to_uci);
-    report_error(err, "failed to create pip to uci");
-    err = pipe(from_uci);
-    report_error(err, "failed to create pip from uci");
-
-    // fork the process
-    pid_t pid;
-    if ((pid = fork()) < 0) {
-        // there was an error forking the process
-        report_error(pid, "errror forking process");
-    } else if (pid == 0) {
-        // this is the child process for the uci client
-        // point to_uci[0] at stdin and from_uci[1] at stdout
-        int cerr = dup2(to_uci[0], STDIN_FILENO);
-        report_error(cerr, "error duplicating to_uci[0]");
-        cerr = dup2(from_uci[1], STDOUT_FILENO);
-        report_error(cerr, "error duplicating from_uci[1]");
-        // maybe also dump stderr into from_uci as well?
-        // cerr = dup2(from_uci[1], STDERR_FILENO);
-#ifndef __linux__
-        // from https://github.com/lucasart/c-chess-cli/blob/master/src/engine.c
-        // Ugly (and slow) workaround for Apple's BSD-based kernels that lack the ability to
-        // atomically set O_CLOEXEC when creating pipes.
-        for (int fd = 3; fd < sysconf(FOPEN_MAX); close(fd++))
-            ;
-#endif
-        const char *args[] = { client_exe, NULL };
-        cerr = execvp(client_exe, args);
-        report_error(cerr, "error executing process");
-    } else {
-        // this is our original process
-        // close the file descriptors we don't need and open the ones we do
-        close(from_uci[1]);
+    int to_uci[2], from_uci[2];
+    if (!make_pipe(to_uci)) {
+        perror("-=-= failed to create pipe to uci");
+        return false;
+    }
+    if (!make_pipe(from_uci)) {
+        perror("-=-= failed to create pipe from uci");
         close(to_uci[0]);
-        FILE *in = fdopen(from_uci[0], "r");
-        FILE *out = fdopen(to_uci[1], "w");
-        cli->pid = pid;
-        cli->in = in;
-        cli->out = out;
+        close(to_uci[1]);
+        return false;
     }
 
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, to_uci[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, from_uci[1], STDOUT_FILENO);
+    if (launch->stderr_path != NULL) {
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, launch->stderr_path,
+            O_WRONLY | O_CREAT | O_APPEND, 0644);
+    }
+#ifdef HAVE_SPAWN_CHDIR
+    if (launch->cwd != NULL) posix_spawn_file_actions_addchdir_np(&actions, launch->cwd);
+#endif
+    // the SIG_IGN above would otherwise carry over into the engine
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+    char *argv[UCI_MAX_ARGS + 2];
+    argv[0] = (char *)launch->exe;
+    for (int i=0; i<launch->arg_count; i++) argv[i + 1] = (char *)launch->args[i];
+    argv[launch->arg_count + 1] = NULL;
+    char **envp = (launch->env_count > 0) ? engine_environment(launch) : environ;
+
+    // unlike fork, this doesn't copy our address space (with the GL context, textures and all)
+    // just to throw it away at the exec, and it tells us right away if the exec failed
+    pid_t pid;
+    const int err = posix_spawnp(&pid, launch->exe, &actions, &attr, argv, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (envp != environ) free(envp);
+    close(from_uci[1]);
+    close(to_uci[0]);
+    if (err != 0) {
+        fprintf(stderr, "-=-= can't start %s: %s\n", launch->exe, strerror(err));
+        close(from_uci[0]);
+        close(to_uci[1]);
+        return false;
+    }
+    cli->pid = pid;
+    cli->in_fd = from_uci[0];
+    cli->out = fdopen(to_uci[1], "w");
+    return true;
+}
+
+void uci_send(uci_client *cli, const char *cmd) {
+    fputs(cmd, cli->out);
+    fflush(cli->out);
+}
+
+void uci_go_command(const search_limits *limits, char cmd[UCI_GO_MAX]) {
+    char *c = cmd;
+    c += sprintf(c, "go");
+    if (limits->wtime > 0) c += sprintf(c, " wtime %lld", (long long)limits->wtime);
+    if (limits->btime > 0) c += sprintf(c, " btime %lld", (long long)limits->btime);
+    if (limits->winc > 0) c += sprintf(c, " winc %lld", (long long)limits->winc);
+    if (limits->binc > 0) c += sprintf(c, " binc %lld", (long long)limits->binc);
+    if (limits->depth > 0) c += sprintf(c, " depth %d", limits->depth);
+    if (limits->movetime > 0) c += sprintf(c, " movetime %d", limits->movetime);
+    if (limits->nodes > 0) c += sprintf(c, " nodes %llu", (unsigned long long)limits->nodes);
+    sprintf(c, "\n");
+}
+
+// true if the line is the given command, alone or followed by arguments
+static bool is_uci_command(const char *line, const char *cmd) {
+    const size_t len = strlen(cmd);
+    return strncmp(line, cmd, len) == 0 && (line[len] == '\0' || line[len] == ' ');
+}
+
+void parse_uci_event(uci_event *ev) {
+    ev->bestmove[0] = '\0';
+    ev->ponder[0] = '\0';
+    if (is_uci_command(ev->line, "info")) {
+        ev->type = UCI_EVENT_INFO;
+    } else if (is_uci_command(ev->line, "bestmove")) {
+        ev->type = UCI_EVENT_BESTMOVE;
+        sscanf(ev->line, "bestmove %5s ponder %5s", ev->bestmove, ev->ponder);
+        // "bestmove (none)" when there's nothing to play
+        if (ev->bestmove[0] == '(') ev->bestmove[0] = '\0';
+    } else if (is_uci_command(ev->line, "readyok")) {
+        ev->type = UCI_EVENT_READYOK;
+    } else if (is_uci_command(ev->line, "uciok")) {
+        ev->type = UCI_EVENT_UCIOK;
+    } else {
+        ev->type = UCI_EVENT_OTHER;
+    }
 }
@@ -1,14 +1,75 @@
 #ifndef UCI_H
 #define UCI_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
+// longest engine line kept; anything past this is dropped
+#define UCI_LINE_MAX 1024
+// how much engine output is read from the pipe at a time
+#define UCI_READ_BUF_SIZE (64 * 1024)
+
+// the limits on a "go" command; zero leaves that one out, and at least one has to be set
+typedef struct {
+    int depth;
+    int movetime;       // milliseconds
+    uint64_t nodes;
+    int64_t wtime;      // clocks and increments in milliseconds, when playing with a clock
+    int64_t btime;
+    int64_t winc;
+    int64_t binc;
+} search_limits;
+
+// longest command uci_go_command writes, with the newline and terminator
+#define UCI_GO_MAX 192
+
 typedef struct {
     int pid;
-    FILE *in;
+    int in_fd;      // the engine's stdout, read raw through a line_reader
     FILE *out;
 } uci_client;
 
-void fork_uci_client(const char *client_exe, uci_client *cli);
+#define UCI_MAX_ARGS 32
+#define UCI_MAX_ENV 16
+
+// how to start an engine process; the strings belong to the caller and have to outlive any
+// restarts made with it
+typedef struct {
+    const char *exe;        // looked up on PATH unless it has a slash in it
+    const char *args[UCI_MAX_ARGS];     // passed after the program name
+    int arg_count;
+    const char *env[UCI_MAX_ENV];       // "NAME=value", set on top of our own environment
+    int env_count;
+    const char *cwd;        // where the engine runs, NULL for our own directory
+    const char *stderr_path;    // the engine's stderr is appended to this, NULL to share ours
+} engine_launch;
+
+typedef enum {
+    UCI_EVENT_UCIOK,
+    UCI_EVENT_READYOK,
+    UCI_EVENT_BESTMOVE,
+    UCI_EVENT_INFO,
+    UCI_EVENT_OTHER,    // id, option and anything else the engine says
+    UCI_EVENT_EOF,      // the engine closed its output, so it quit or died
+} uci_event_type;
+
+typedef struct {
+    uci_event_type type;
+    char bestmove[6];   // for UCI_EVENT_BESTMOVE, empty when the engine has no move
+    char ponder[6];     // for UCI_EVENT_BESTMOVE, empty when the engine didn't say
+    char line[UCI_LINE_MAX];
+} uci_event;
+
+// starts the engine with its stdin and stdout on pipes to us; false (after saying why) when it
+// can't be started
+bool spawn_uci_client(const engine_launch *launch, uci_client *cli);
+// writes a command (ending in a newline) to the engine and flushes it
+void uci_send(uci_client *cli, const char *cmd);
+
+// writes "go" with the limits that are set, ending in a newline
+void uci_go_command(const search_limits *limits, char cmd[UCI_GO_MAX]);
+// sorts out what kind of line ev->line is and fills in the rest of the event from it
+void parse_uci_event(uci_event *ev);
 
 #endif //UCI_H
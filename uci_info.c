@@ -0,0 +1,138 @@
+#include "uci_info.h"
+#include <stdlib.h>
+#include <string.h>
+#include "moves.h"
+
+// finds the next whitespace separated token at or after *s and moves *s past it
+static const char *next_token(const char **s, size_t *len) {
+    const char *p = *s;
+    while (*p == ' ' || *p == '\t') p++;
+    const char *start = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t') p++;
+    *s = p;
+    *len = p - start;
+    return (*len > 0) ? start : NULL;
+}
+
+static bool token_is(const char *tok, size_t len, const char *word) {
+    return strlen(word) == len && strncmp(tok, word, len) == 0;
+}
+
+// the number in the next token; malformed numbers come out as 0 like atoi
+static int64_t next_number(const char **s) {
+    size_t len;
+    const char *tok = next_token(s, &len);
+    return (tok != NULL) ? strtoll(tok, NULL, 10) : 0;
+}
+
+// true for anything shaped like a UCI move, so the pv ends at the next keyword
+static bool is_move_token(const char *tok, size_t len) {
+    return (len == 4 || len == 5) && tok[0] >= 'a' && tok[0] <= 'h' && tok[1] >= '1' && tok[1] <= '8' &&
+        tok[2] >= 'a' && tok[2] <= 'h' && tok[3] >= '1' && tok[3] <= '8';
+}
+
+// packs pv moves while they're legal, then skips the rest of the moves; returns where the moves end
+static const char *parse_pv(game_t *game, const char *s, uci_info *info) {
+    int played = 0;
+    bool legal = true;
+    while (true) {
+        const char *rest = s;
+        size_t len;
+        const char *tok = next_token(&rest, &len);
+        if (tok == NULL || !is_move_token(tok, len)) break;
+        s = rest;
+        if (!legal || played == UCI_INFO_MAX_PV) continue;
+        char mstr[6];
+        memcpy(mstr, tok, len);
+        mstr[len] = '\0';
+        const packed_move_t pm = str_to_packed_move(game, mstr);
+        if (pm == MOVE_NONE) {
+            legal = false;
+            continue;
+        }
+        info->pv[played++] = pm;
+        make_move(game, unpack_move(game, pm));
+    }
+    for (int i=0; i<played; i++) unmake_move(game);
+    info->pv_len = played;
+    return s;
+}
+
+bool parse_uci_info(game_t *game, const char *line, uci_info *info) {
+    const char *s = line;
+    size_t len;
+    const char *tok = next_token(&s, &len);
+    if (tok == NULL || !token_is(tok, len, "info")) return false;
+    info->fields = 0;
+    info->pv_len = 0;
+    while ((tok = next_token(&s, &len)) != NULL) {
+        if (token_is(tok, len, "depth")) {
+            info->depth = next_number(&s);
+            info->fields |= INFO_DEPTH;
+        } else if (token_is(tok, len, "seldepth")) {
+            info->seldepth = next_number(&s);
+            info->fields |= INFO_SELDEPTH;
+        } else if (token_is(tok, len, "multipv")) {
+            info->multipv = next_number(&s);
+            info->fields |= INFO_MULTIPV;
+        } else if (token_is(tok, len, "cp")) {
+            // from "score cp <x>" or "score mate <y>", maybe followed by a bound
+            info->score_cp = next_number(&s);
+            info->fields |= INFO_SCORE_CP;
+        } else if (token_is(tok, len, "mate")) {
+            info->score_mate = next_number(&s);
+            info->fields |= INFO_SCORE_MATE;
+        } else if (token_is(tok, len, "lowerbound")) {
+            info->fields |= INFO_LOWERBOUND;
+        } else if (token_is(tok, len, "upperbound")) {
+            info->fields |= INFO_UPPERBOUND;
+        } else if (token_is(tok, len, "nodes")) {
+            info->nodes = next_number(&s);
+            info->fields |= INFO_NODES;
+        } else if (token_is(tok, len, "nps")) {
+            info->nps = next_number(&s);
+            info->fields |= INFO_NPS;
+        } else if (token_is(tok, len, "hashfull")) {
+            info->hashfull = next_number(&s);
+            info->fields |= INFO_HASHFULL;
+        } else if (token_is(tok, len, "tbhits")) {
+            info->tbhits = next_number(&s);
+            info->fields |= INFO_TBHITS;
+        } else if (token_is(tok, len, "time")) {
+            info->time = next_number(&s);
+            info->fields |= INFO_TIME;
+        } else if (token_is(tok, len, "pv")) {
+            s = parse_pv(game, s, info);
+            info->fields |= INFO_PV;
+        } else if (token_is(tok, len, "string")) {
+            // free text to the end of the line
+            break;
+        }
+        // anything else (currmove, currmovenumber, cpuload, refutation, ...) and its arguments
+        // get skipped a token at a time
+    }
+    return true;
+}
+
+void merge_uci_info(uci_info *dst, const uci_info *src) {
+    const unsigned f = src->fields;
+    if (f & INFO_DEPTH) dst->depth = src->depth;
+    if (f & INFO_SELDEPTH) dst->seldepth = src->seldepth;
+    if (f & INFO_MULTIPV) dst->multipv = src->multipv;
+    if (f & (INFO_SCORE_CP | INFO_SCORE_MATE)) {
+        // a new score replaces the old one along with its bound, whichever kind it was
+        dst->fields &= ~(INFO_SCORE_CP | INFO_SCORE_MATE | INFO_LOWERBOUND | INFO_UPPERBOUND);
+        dst->score_cp = src->score_cp;
+        dst->score_mate = src->score_mate;
+    }
+    if (f & INFO_NODES) dst->nodes = src->nodes;
+    if (f & INFO_NPS) dst->nps = src->nps;
+    if (f & INFO_HASHFULL) dst->hashfull = src->hashfull;
+    if (f & INFO_TBHITS) dst->tbhits = src->tbhits;
+    if (f & INFO_TIME) dst->time = src->time;
+    if (f & INFO_PV) {
+        memcpy(dst->pv, src->pv, src->pv_len * sizeof(src->pv[0]));
+        dst->pv_len = src->pv_len;
+    }
+    dst->fields |= f;
+}
@@ -0,0 +1,52 @@
+#ifndef UCI_INFO_H
+#define UCI_INFO_H
+
+#include <stdint.h>
+#include "chess_types.h"
+
+// longest principal variation kept from an info line
+#define UCI_INFO_MAX_PV 32
+
+// which fields an info line carried, one bit each in uci_info.fields
+#define INFO_DEPTH (1 << 0)
+#define INFO_SELDEPTH (1 << 1)
+#define INFO_MULTIPV (1 << 2)
+#define INFO_SCORE_CP (1 << 3)
+#define INFO_SCORE_MATE (1 << 4)
+#define INFO_LOWERBOUND (1 << 5)
+#define INFO_UPPERBOUND (1 << 6)
+#define INFO_NODES (1 << 7)
+#define INFO_NPS (1 << 8)
+#define INFO_HASHFULL (1 << 9)
+#define INFO_TBHITS (1 << 10)
+#define INFO_TIME (1 << 11)
+#define INFO_PV (1 << 12)
+// the fields that describe one line of the search rather than the search as a whole
+#define INFO_LINE_FIELDS (INFO_DEPTH | INFO_SELDEPTH | INFO_SCORE_CP | INFO_SCORE_MATE | INFO_LOWERBOUND | \
+    INFO_UPPERBOUND | INFO_PV)
+
+// everything useful in a UCI "info" line, parsed in place with no allocation
+typedef struct {
+    unsigned fields;    // INFO_* bits for the fields below that are set
+    int depth;
+    int seldepth;
+    int multipv;
+    int score_cp;       // centipawns from the engine's point of view
+    int score_mate;     // moves to mate, negative when the engine is getting mated
+    uint64_t nodes;
+    uint64_t nps;
+    int hashfull;       // permille
+    uint64_t tbhits;
+    int time;           // milliseconds
+    int pv_len;
+    packed_move_t pv[UCI_INFO_MAX_PV];
+} uci_info;
+
+// parses an engine "info" line, false for any other line. The pv moves are checked and packed
+// against the game, which has to be in the position the engine is searching; they are played
+// through on it and taken back again. The pv stops at the first move that isn't legal.
+bool parse_uci_info(game_t *game, const char *line, uci_info *info);
+// copies the fields src has over the ones in dst, keeping the rest of dst
+void merge_uci_info(uci_info *dst, const uci_info *src);
+
+#endif //UCI_INFO_H